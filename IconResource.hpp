@@ -2,6 +2,7 @@
 
 #include <windows.h>
 #include <vector>
+#include <memory>
 
 namespace IconResource {
 
@@ -48,16 +49,31 @@ class ImageContainer {
 public:
 	typedef std::vector<BYTE> IconImage;
 	typedef ICONDIRENTRY IconEntry;
+	typedef std::shared_ptr<const void> Holder; // 借用元（octet やマッピング）の寿命管理
 private:
 	ICONDIR dir_;
 	struct Entry {
-		Entry() : id(-1) { ::ZeroMemory(&icon, sizeof(icon)); }
-		Entry(const BYTE *src) : id(-1) {
+		Entry() : id(-1), data(nullptr), size(0) { ::ZeroMemory(&icon, sizeof(icon)); }
+		Entry(const BYTE *src) : id(-1), data(nullptr), size(0) {
 			memcpy(&icon, src, sizeof(icon));
 		}
 		int id;
 		IconEntry icon;
-		IconImage image;
+		const BYTE *data; // 画像データ（hold が指す領域内を参照）
+		size_t size;
+		Holder hold;
+
+		void borrow(const BYTE *ptr, size_t len, const Holder &keep) {
+			data = len > 0 ? ptr : nullptr;
+			size = len;
+			hold = keep;
+		}
+		template <typename T>
+		void assign(const T &begin, const T &end) {
+			// 自前の領域に昇格
+			std::shared_ptr<IconImage> own = std::make_shared<IconImage>(begin, end);
+			borrow(own->empty() ? nullptr : &own->front(), own->size(), own);
+		}
 	};
 	std::vector<Entry> entries_;
 
@@ -108,8 +124,8 @@ private:
 		return true;
 	}
 	static void ConvertEntry(const Entry &ent, IconEntry &icon, bool iscursor) {
-		const size_t len = ent.image.size();
-		const BYTE *img = len > 0 ? &ent.image.front() : nullptr;
+		const size_t len = ent.size;
+		const BYTE *img = ent.data;
 		ImageHeader head;
 		if (FetchPNGHeader(img, len, head)) {
 			if (head.width < 256 && head.height < 256) {
@@ -174,13 +190,26 @@ public:
 	bool assignImage(size_t index, const T &begin, const T &end) {
 		Entry *ent = getEntry(index);
 		if (!ent) return false;
-		ent->image.assign(begin, end);
-		ent->icon.dwBytesInRes = ent->image.size();
+		ent->assign(begin, end);
+		ent->icon.dwBytesInRes = (DWORD)ent->size;
 		return true;
 	}
-	const IconImage* getImage(size_t index) const {
+	// コピーせずに参照だけ持つ（keep が ptr の寿命を保証すること）
+	bool borrowImage(size_t index, const BYTE *ptr, size_t len, const Holder &keep) {
+		Entry *ent = getEntry(index);
+		if (!ent) return false;
+		ent->borrow(ptr, len, keep);
+		ent->icon.dwBytesInRes = (DWORD)len;
+		return true;
+	}
+	// keep には ptr の寿命を保証する参照が入る
+	bool getImage(size_t index, const BYTE* &ptr, size_t &len, Holder *keep = nullptr) const {
 		const Entry *ent = getEntry(index);
-		return ent ? &ent->image : nullptr;
+		if (!ent) return false;
+		ptr = ent->data;
+		len = ent->size;
+		if (keep) *keep = ent->hold;
+		return true;
 	}
 
 	bool getHotSpot(size_t index, WORD &x, WORD &y) {
@@ -209,8 +238,14 @@ public:
 		}
 	}
 
-	bool load(const BYTE *ptr, size_t len) {
+	// keep を渡すと画像は ptr を直接参照する（無ければ全体を一度だけ複製して共有）
+	bool load(const BYTE *ptr, size_t len, Holder keep = Holder()) {
 		if (len < sizeof(dir_)) return false;
+		if (!keep) {
+			std::shared_ptr<IconImage> copy = std::make_shared<IconImage>(ptr, ptr + len);
+			ptr  = &copy->front();
+			keep = copy;
+		}
 		const BYTE  *orig_ptr = ptr;
 		const size_t orig_len = len;
 
@@ -245,35 +280,73 @@ public:
 				clear();
 				return false;
 			}
-			ent.image.assign(orig_ptr + offset, orig_ptr + offset + size);
+			ent.borrow(orig_ptr + offset, size, keep);
 		}
 		return true;
 	}
 
-	template <typename T>
-	void save(std::vector<T> &vec) {
-		static_assert(sizeof (T) == 1, "sizeof(T) == 1");
-		size_t total = sizeof(dir_) + sizeof(IconEntry) * entries_.size();
-		size_t offset = total;
+	// ICONDIR + ICONDIRENTRY[] の大きさ（画像はこの直後に並ぶ）
+	size_t headerSize() const {
+		return sizeof(dir_) + sizeof(IconEntry) * entries_.size();
+	}
+	// 画像の合計サイズ
+	size_t imageSize() const {
+		size_t total = 0;
+		for (auto it = entries_.cbegin(); it != entries_.cend(); ++it) total += it->size;
+		return total;
+	}
+	// dst に headerSize() バイトのヘッダを書き出す
+	void saveHeader(BYTE *dst) const {
+		size_t offset = headerSize();
+		memcpy(dst, &dir_, sizeof(dir_));
+		dst += sizeof(dir_);
 		for (auto it = entries_.cbegin(); it != entries_.cend(); ++it) {
-			total += it->image.size();
+			IconEntry ent;
+			memcpy(&ent, &it->icon, sizeof(ent));
+			ent.dwImageOffset = (DWORD)offset;
+			memcpy(dst, &ent, sizeof(ent));
+			dst += sizeof(ent);
+			offset += it->size;
 		}
-		vec.resize(total);
-		T* ptr = &vec.front();
-		T* const imgbase = ptr;
+	}
+	// 画像をエントリ順に一つの領域へ詰める（既に連続していれば何もしない）
+	//   ptr/len に詰めた画像全体を返す
+	void packImages(const BYTE* &ptr, size_t &len) {
+		const BYTE *next = nullptr;
+		bool packed = true;
+		len = 0;
+		for (auto it = entries_.cbegin(); it != entries_.cend(); ++it) {
+			if (!it->size) continue;
+			if (next && it->data != next) packed = false;
+			if (!len) ptr = it->data;
+			next = it->data + it->size;
+			len += it->size;
+		}
+		if (!len) ptr = nullptr;
+		if (packed) return;
 
-		memcpy(ptr, &dir_, sizeof(dir_));
-		ptr += sizeof(dir_);
+		std::shared_ptr<IconImage> arena = std::make_shared<IconImage>(len);
+		BYTE *dst = &arena->front();
+		for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+			if (!it->size) continue;
+			memcpy(dst, it->data, it->size);
+			it->borrow(dst, it->size, arena);
+			dst += it->size;
+		}
+		ptr = &arena->front();
+	}
 
+	template <typename T>
+	void save(std::vector<T> &vec) const {
+		static_assert(sizeof (T) == 1, "sizeof(T) == 1");
+		const size_t head = headerSize();
+		vec.resize(head + imageSize());
+		BYTE *ptr = reinterpret_cast<BYTE*>(&vec.front());
+		saveHeader(ptr);
+		ptr += head;
 		for (auto it = entries_.cbegin(); it != entries_.cend(); ++it) {
-			IconEntry ent;
-			memcpy(&ent, &it->icon, sizeof(ent));
-			ent.dwImageOffset = offset;
-			memcpy(ptr, &ent, sizeof(ent));
-			ptr += sizeof(ent);
-			const size_t imgsz = it->image.size();
-			if (imgsz > 0) memcpy(imgbase + offset, &it->image.front(), imgsz);
-			offset += imgsz;
+			if (it->size > 0) memcpy(ptr, it->data, it->size);
+			ptr += it->size;
 		}
 	}
 
@@ -285,9 +358,11 @@ public:
 			entries_.push_back(Entry());
 			Entry *ent = &entries_.back();
 			ICONHDR hdr = {0};
-			if ((*it)(hdr, ent->image, &ent->id)) {
+			std::shared_ptr<IconImage> own = std::make_shared<IconImage>();
+			if ((*it)(hdr, *own, &ent->id)) {
+				ent->borrow(own->empty() ? nullptr : &own->front(), own->size(), own);
 				memcpy(&ent->icon.ih, &hdr, sizeof(hdr));
-				ent->icon.dwBytesInRes = ent->image.size();
+				ent->icon.dwBytesInRes = (DWORD)ent->size;
 				ent->icon.dwImageOffset = 0;
 			} else {
 				clear();
@@ -319,6 +394,28 @@ public:
 	bool getID(size_t index, int &id) const { const GrpEntry *ent = getEntry(index); if (ent) id = (int)ent->nID;  return ent != nullptr; }
 	bool setID(size_t index, int  id)       {       GrpEntry *ent = getEntry(index); if (ent) ent->nID = (WORD)id; return ent != nullptr; }
 
+	// 指定サイズ・色数に最も近い画像の番号（LookupIconIdFromDirectoryEx 相当）
+	//   サイズの差が最小のものから色数の差が最小のものを選ぶ（bpp==0 は最大の色数）
+	//   見つからなければ -1
+	int findBest(int width, int height, int bpp = 0) const {
+		int best = -1;
+		int bestSize = 0, bestBits = 0;
+		for (size_t n = 0; n < entries_.size(); ++n) {
+			const ICONHDR &ih = entries_[n].ih;
+			const int w = ih.bWidth  ? ih.bWidth  : 256;
+			const int h = ih.bHeight ? ih.bHeight : 256;
+			const int size = Abs(w - width) + Abs(h - height);
+			const int bits = EntryBits(ih);
+			const int diff = bpp > 0 ? Abs(bits - bpp) : -bits;
+			if (best < 0 || size < bestSize || (size == bestSize && diff < bestBits)) {
+				best = (int)n;
+				bestSize = size;
+				bestBits = diff;
+			}
+		}
+		return best;
+	}
+
 	bool load(const BYTE *ptr, size_t len) {
 		if (len < sizeof(dir_)) return false;
 
@@ -349,8 +446,15 @@ public:
 		return true;
 	}
 
+	const ICONDIR& getDir() const { return dir_; }
+	// GRPICONDIRENTRY[] はそのまま保存形式で並んでいる
+	const BYTE* getEntries(size_t &len) const {
+		len = sizeof(GrpEntry) * entries_.size();
+		return entries_.empty() ? nullptr : reinterpret_cast<const BYTE*>(&entries_.front());
+	}
+
 	template <typename T>
-	void save(std::vector<T> &vec) {
+	void save(std::vector<T> &vec) const {
 		static_assert(sizeof (T) == 1, "sizeof(T) == 1");
 		const size_t grpsz = sizeof(GrpEntry);
 		size_t total = sizeof(dir_) + grpsz * entries_.size();
@@ -391,32 +495,57 @@ public:
 	template <class IMAGEGET>
 	bool extract(ImageContainer &image, IMAGEGET &iget) const {
 		typedef typename IMAGEGET::iterator iterator;
+		return extractEach(image, [&](size_t n, int id) {
+			iterator begin, end;
+			return iget(n, id, begin, end) && image.assignImage(n, begin, end);
+		});
+	}
+	// 画像をコピーせずに参照する版: iget(n, id, const BYTE* &ptr, size_t &len)
+	//   keep が取得した領域の寿命を保証すること
+	template <class IMAGEGET>
+	bool extract(ImageContainer &image, IMAGEGET &iget, const ImageContainer::Holder &keep) const {
+		return extractEach(image, [&](size_t n, int id) {
+			const BYTE *ptr = nullptr;
+			size_t len = 0;
+			return iget(n, id, ptr, len) && image.borrowImage(n, ptr, len, keep);
+		});
+	}
+
+	bool extract(ImageContainer &image) const {
 		image.reset(dir_, entries_.size());
 		size_t n = 0;
 		for (auto it = entries_.begin(); it != entries_.end(); ++it, ++n) {
 			ImageContainer::IconEntry icon = {0};
 			memcpy(&icon, &it->ih, sizeof(ICONHDR));
-			icon.dwBytesInRes = it->dwBytesInRes;
+			icon.dwBytesInRes = 0;
 			const int id = it->nID;
-			image.setIcon(n, icon, &id);
-			iterator begin, end;
-			if (!iget(n, id, begin, end) || !image.assignImage(n, begin, end)) {
+			if(!image.setIcon(n, icon, &id)) {
 				image.clear();
 				return false;
 			}
 		}
 		return true;
 	}
+private:
+	static int Abs(int v) { return v < 0 ? -v : v; }
+	static int EntryBits(const ICONHDR &ih) {
+		if (ih.ico.wBitCount) return ih.ico.wBitCount * (ih.ico.wPlanes ? ih.ico.wPlanes : 1);
+		int bits = 0;
+		for (int colors = ih.bColorCount; colors > 1; colors >>= 1) ++bits;
+		return bits ? bits : 8; // bColorCount==0 は256色以上
+	}
 
-	bool extract(ImageContainer &image) const {
+	template <class F>
+	bool extractEach(ImageContainer &image, F get) const {
 		image.reset(dir_, entries_.size());
 		size_t n = 0;
 		for (auto it = entries_.begin(); it != entries_.end(); ++it, ++n) {
 			ImageContainer::IconEntry icon = {0};
 			memcpy(&icon, &it->ih, sizeof(ICONHDR));
-			icon.dwBytesInRes = 0;
+			icon.dwBytesInRes = it->dwBytesInRes;
 			const int id = it->nID;
-			if(!image.setIcon(n, icon, &id)) {
+			image.setIcon(n, icon, &id);
+			if (!get(n, id)) {
 				image.clear();
 				return false;
 			}
@@ -0,0 +1,1760 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PERESOURCE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+namespace PEResource {
+
+#ifndef _WIN32
+typedef std::uint8_t  BYTE;
+typedef std::uint16_t WORD;
+typedef std::uint32_t DWORD;
+#endif
+
+using std::size_t;
+
+//--------------------------------------------------------------
+// バイト列読み出し（アライメント非依存）
+static inline WORD  ReadU16(const BYTE *p) { return (WORD)(p[0] | (p[1] << 8)); }
+static inline DWORD ReadU32(const BYTE *p) { return (DWORD)p[0] | ((DWORD)p[1] << 8) | ((DWORD)p[2] << 16) | ((DWORD)p[3] << 24); }
+
+//--------------------------------------------------------------
+// データ内容のハッシュ（XXH64）
+//   4系列を独立に回すので1ループ32バイトがパイプラインで並列に進む
+class ContentHash {
+	typedef std::uint64_t U64;
+	static const U64 P1 = 11400714785074694791ULL;
+	static const U64 P2 = 14029467366897019727ULL;
+	static const U64 P3 =  1609587929392839161ULL;
+	static const U64 P4 =  9650029242287828579ULL;
+	static const U64 P5 =  2870177450012600261ULL;
+	static U64 Rotl(U64 v, int n) { return (v << n) | (v >> (64 - n)); }
+	static U64 Read64(const BYTE *p) { U64 v; memcpy(&v, p, sizeof(v)); return v; } // little endian 前提
+	static U64 Round(U64 acc, U64 in) { return Rotl(acc + in * P2, 31) * P1; }
+	static U64 Merge(U64 acc, U64 v) { return (acc ^ Round(0, v)) * P1 + P4; }
+public:
+	static U64 Calc(const BYTE *p, size_t len, U64 seed = 0) {
+		const BYTE *const end = p + len;
+		U64 h;
+		if (len >= 32) {
+			U64 v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+			const BYTE *const limit = end - 32;
+			do {
+				v1 = Round(v1, Read64(p));
+				v2 = Round(v2, Read64(p + 8));
+				v3 = Round(v3, Read64(p + 16));
+				v4 = Round(v4, Read64(p + 24));
+				p += 32;
+			} while (p <= limit);
+			h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+			h = Merge(h, v1); h = Merge(h, v2); h = Merge(h, v3); h = Merge(h, v4);
+		} else {
+			h = seed + P5;
+		}
+		h += (U64)len;
+		for (; p + 8 <= end; p += 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * P1 + P4;
+		if (p + 4 <= end) { h = Rotl(h ^ ((U64)ReadU32(p) * P1), 23) * P2 + P3; p += 4; }
+		for (; p < end; ++p) h = Rotl(h ^ (*p * P5), 11) * P1;
+		h ^= h >> 33; h *= P2;
+		h ^= h >> 29; h *= P3;
+		h ^= h >> 32;
+		return h;
+	}
+};
+
+//--------------------------------------------------------------
+// PE の CheckSum（16bit 単位の1の補数和）
+//   書き出すデータを順に write で渡す（ファイル上の偶奇を引き継ぐので分割して渡してよい）
+class CheckSum {
+	typedef std::uint64_t U64;
+public:
+	explicit CheckSum(size_t pos = 0) : sum_(0), odd_((pos & 1) != 0) {}
+
+	bool write(const void *ptr, size_t len) {
+		const BYTE *p = static_cast<const BYTE*>(ptr);
+		if (len == 0) return true;
+		if (odd_) { sum_ += (U64)*p++ << 8; --len; odd_ = false; }
+		sum_ += Words(p, len & ~(size_t)1);
+		if (len & 1) { sum_ += p[len - 1]; odd_ = true; }
+		return true;
+	}
+	// 別の位置から計算した和を足し合わせる（それぞれ開始位置を指定して作ったもの）
+	void merge(const CheckSum &other) { sum_ += other.sum_; }
+
+	WORD value() const { return Fold(sum_); }
+
+	// ファイル全体の和とファイルサイズから CheckSum を得る
+	static DWORD Complete(WORD sum, size_t filesize) { return (DWORD)(sum + filesize); }
+	// 既存の CheckSum の一部を差し替える（sum から old を除き cur を加える）
+	static WORD Replace(WORD sum, WORD old, WORD cur) { return Fold((U64)sum + (WORD)~old + cur); }
+
+private:
+	static WORD Fold(U64 v) {
+		while (v >> 16) v = (v & 0xFFFF) + (v >> 16);
+		return (WORD)v;
+	}
+	// len は偶数
+	static U64 Words(const BYTE *p, size_t len) {
+		U64 total = 0;
+#ifdef PERESOURCE_SSE2
+		// 16bit を32bit レーンに広げて加算（1ブロック 4096*16 バイトならレーンは溢れない）
+		const __m128i zero = _mm_setzero_si128();
+		while (len >= 16) {
+			const size_t blocks = std::min(len / 16, (size_t)4096);
+			__m128i acc = zero;
+			for (size_t n = 0; n < blocks; ++n, p += 16) {
+				const __m128i v = _mm_loadu_si128((const __m128i*)p);
+				acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+				acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+			}
+			std::uint32_t lanes[4];
+			_mm_storeu_si128((__m128i*)lanes, acc);
+			total += (U64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			len -= blocks * 16;
+		}
+#endif
+		for (; len >= 2; len -= 2, p += 2) total += ReadU16(p);
+		return total;
+	}
+	U64 sum_;
+	bool odd_;
+};
+
+//--------------------------------------------------------------
+// 読み込み専用ファイルマッピング
+class FileMapping {
+public:
+#ifdef _WIN32
+	typedef wchar_t PathChar;
+#else
+	typedef char PathChar;
+#endif
+	FileMapping() : data_(nullptr), size_(0) {}
+	~FileMapping() { close(); }
+
+	bool open(const PathChar *path) {
+		close();
+#ifdef _WIN32
+		HANDLE file = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER len;
+		if (!::GetFileSizeEx(file, &len) || len.QuadPart <= 0 || (unsigned long long)len.QuadPart > (size_t)-1) {
+			::CloseHandle(file);
+			return false;
+		}
+		HANDLE map = ::CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		::CloseHandle(file);
+		if (!map) return false;
+		void *ptr = ::MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+		::CloseHandle(map);
+		if (!ptr) return false;
+		size_ = (size_t)len.QuadPart;
+#else
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return false;
+		}
+		void *ptr = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (ptr == MAP_FAILED) return false;
+		size_ = (size_t)st.st_size;
+#endif
+		data_ = static_cast<const BYTE*>(ptr);
+		return true;
+	}
+	void close() {
+		if (!data_) return;
+#ifdef _WIN32
+		::UnmapViewOfFile(data_);
+#else
+		::munmap(const_cast<BYTE*>(data_), size_);
+#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	const BYTE* data() const { return data_; }
+	size_t      size() const { return size_; }
+	bool      isOpen() const { return data_ != nullptr; }
+private:
+	FileMapping(const FileMapping&);
+	FileMapping& operator=(const FileMapping&);
+
+	const BYTE *data_;
+	size_t size_;
+};
+
+//--------------------------------------------------------------
+// リソースのタイプ・名前（文字列の場合は str!=nullptr）
+struct ResName {
+	const char16_t *str;
+	size_t len;
+	WORD id;
+
+	ResName() : str(nullptr), len(0), id(0) {}
+	ResName(WORD id) : str(nullptr), len(0), id(id) {}
+	ResName(const char16_t *s, size_t n) : str(s), len(n), id(0) {}
+
+	bool isString() const { return str != nullptr; }
+
+	// FindResource と同様に文字列名は大文字小文字を区別しない
+	static char16_t FoldCase(char16_t c) { return (c >= u'a' && c <= u'z') ? (char16_t)(c - 0x20) : c; }
+	bool equals(const ResName &other) const { return Compare(*this, other) == 0; }
+
+	// 名前付きエントリ(大文字小文字同一視)が先，ID エントリは昇順
+	static int Compare(const ResName &a, const ResName &b) {
+		if (a.isString() != b.isString()) return a.isString() ? -1 : 1;
+		if (!a.isString()) return (a.id < b.id) ? -1 : (a.id > b.id) ? 1 : 0;
+		const size_t len = (a.len < b.len) ? a.len : b.len;
+		for (size_t n = 0; n < len; ++n) {
+			const char16_t ca = FoldCase(a.str[n]), cb = FoldCase(b.str[n]);
+			if (ca != cb) return (ca < cb) ? -1 : 1;
+		}
+		return (a.len < b.len) ? -1 : (a.len > b.len) ? 1 : 0;
+	}
+};
+
+// リソースデータ
+struct ResData {
+	const BYTE *ptr;
+	DWORD size;
+	DWORD codepage;
+	WORD  lang;
+	const BYTE *entry; // IMAGE_RESOURCE_DATA_ENTRY（Index 経由では nullptr）
+};
+
+//--------------------------------------------------------------
+// PE32/PE32+ イメージ（リソースディレクトリ参照）
+class Image {
+public:
+	enum {
+		DIR_RESOURCE = 2,
+		DIR_SECURITY = 4,
+	};
+	struct Section {
+		char  Name[8];
+		DWORD VirtualSize;
+		DWORD VirtualAddress;
+		DWORD SizeOfRawData;
+		DWORD PointerToRawData;
+		DWORD Characteristics;
+	};
+
+	Image() { clear(); }
+
+	void clear() {
+		base_ = nullptr;
+		size_ = 0;
+		is64_ = false;
+		ntOffset_ = optOffset_ = secOffset_ = 0;
+		sections_.clear();
+		rsrcRva_ = rsrcSize_ = 0;
+		rsrc_ = nullptr;
+		rsrcLen_ = 0;
+	}
+
+	bool load(const BYTE *ptr, size_t len) {
+		clear();
+		if (!ptr || len < 0x40 || ptr[0] != 'M' || ptr[1] != 'Z') return false;
+		const DWORD nt = ReadU32(ptr + 0x3C);
+		if ((size_t)nt + 4 + 20 + 2 > len || memcmp(ptr + nt, "PE\0\0", 4) != 0) return false;
+
+		const BYTE *fh = ptr + nt + 4;
+		const WORD nsec   = ReadU16(fh + 2);
+		const WORD optlen = ReadU16(fh + 16);
+		const size_t opt = nt + 4 + 20;
+		const size_t sec = opt + optlen;
+		if (sec + (size_t)nsec * 40 > len) return false;
+
+		const WORD magic = ReadU16(ptr + opt);
+		if      (magic == 0x10B) is64_ = false;
+		else if (magic == 0x20B) is64_ = true;
+		else return false;
+
+		base_ = ptr;
+		size_ = len;
+		ntOffset_  = nt;
+		optOffset_ = opt;
+		secOffset_ = sec;
+		sections_.resize(nsec);
+		for (WORD n = 0; n < nsec; ++n) {
+			const BYTE *s = ptr + sec + n * 40;
+			Section &ent = sections_[n];
+			memcpy(ent.Name, s, 8);
+			ent.VirtualSize      = ReadU32(s +  8);
+			ent.VirtualAddress   = ReadU32(s + 12);
+			ent.SizeOfRawData    = ReadU32(s + 16);
+			ent.PointerToRawData = ReadU32(s + 20);
+			ent.Characteristics  = ReadU32(s + 36);
+		}
+
+		DWORD rva = 0, size = 0;
+		if (getDataDirectory(DIR_RESOURCE, rva, size) && rva && size) {
+			size_t avail = 0;
+			const BYTE *p = fromRva(rva, &avail);
+			if (p) {
+				rsrcRva_  = rva;
+				rsrcSize_ = size;
+				rsrc_     = p;
+				rsrcLen_  = (avail < size) ? avail : size;
+			}
+		}
+		return true;
+	}
+
+	bool isValid()    const { return base_ != nullptr; }
+	bool is64()       const { return is64_; }
+	bool hasResource() const { return rsrc_ != nullptr && rsrcLen_ >= 16; }
+
+	const BYTE* base() const { return base_; }
+	size_t      size() const { return size_; }
+	const std::vector<Section>& sections() const { return sections_; }
+
+	size_t fileHeaderOffset()     const { return ntOffset_ + 4; }
+	size_t optionalHeaderOffset() const { return optOffset_; }
+	size_t sectionTableOffset()   const { return secOffset_; }
+	DWORD  resourceRva()          const { return rsrcRva_; }
+	DWORD  resourceSize()         const { return rsrcSize_; }
+
+	// IMAGE_OPTIONAL_HEADER のフィールド（PE32/PE32+ 共通位置のもの）
+	enum {
+		OPT_SECTION_ALIGNMENT = 32,
+		OPT_FILE_ALIGNMENT    = 36,
+		OPT_SIZE_OF_INITDATA  =  8,
+		OPT_SIZE_OF_IMAGE     = 56,
+		OPT_SIZE_OF_HEADERS   = 60,
+		OPT_CHECKSUM          = 64,
+	};
+	DWORD getOptional(size_t field) const { return ReadU32(base_ + optOffset_ + field); }
+	size_t dataDirectoryOffset(int index) const { return optOffset_ + (is64_ ? 112 : 96) + index * 8; }
+
+	bool getDataDirectory(int index, DWORD &rva, DWORD &size) const {
+		const size_t cntpos = optOffset_ + (is64_ ? 108 : 92);
+		if (cntpos + 4 > secOffset_) return false;
+		const DWORD count = ReadU32(base_ + cntpos);
+		const size_t pos = cntpos + 4 + index * 8;
+		if ((DWORD)index >= count || pos + 8 > secOffset_) return false;
+		rva  = ReadU32(base_ + pos);
+		size = ReadU32(base_ + pos + 4);
+		return true;
+	}
+
+	// RVA -> ファイル上のポインタ（avail にはセクション内の残りバイト数）
+	const BYTE* fromRva(DWORD rva, size_t *avail = nullptr) const {
+		for (auto it = sections_.cbegin(); it != sections_.cend(); ++it) {
+			const DWORD vsize = it->VirtualSize ? it->VirtualSize : it->SizeOfRawData;
+			if (rva < it->VirtualAddress || rva - it->VirtualAddress >= vsize) continue;
+			const DWORD delta = rva - it->VirtualAddress;
+			if (delta >= it->SizeOfRawData) return nullptr; // 未初期化領域
+			const size_t pos = (size_t)it->PointerToRawData + delta;
+			if (pos >= size_) return nullptr;
+			size_t rest = it->SizeOfRawData - delta;
+			if (pos + rest > size_) rest = size_ - pos;
+			if (avail) *avail = rest;
+			return base_ + pos;
+		}
+		return nullptr;
+	}
+
+	//--------------------------------------------------------------
+	// リソースディレクトリ操作
+
+	// ディレクトリエントリを列挙: func(const ResName &name, DWORD value)
+	// value は最上位ビットが立っていればサブディレクトリ
+	template <class F>
+	bool enumDirectory(DWORD dir, F &func) const {
+		if (!hasResource() || (size_t)dir + 16 > rsrcLen_) return false;
+		const BYTE *p = rsrc_ + dir;
+		const size_t count = (size_t)ReadU16(p + 12) + ReadU16(p + 14);
+		const BYTE *ent = p + 16;
+		if ((size_t)dir + 16 + count * 8 > rsrcLen_) return false;
+		for (size_t n = 0; n < count; ++n, ent += 8) {
+			ResName name;
+			if (!getEntryName(ReadU32(ent), name)) return false;
+			if (!func(name, ReadU32(ent + 4))) break;
+		}
+		return true;
+	}
+
+	bool findDirectory(DWORD dir, const ResName &key, DWORD &value) const {
+		struct Finder {
+			const ResName &key;
+			DWORD &value;
+			bool found;
+			bool operator()(const ResName &name, DWORD v) {
+				if (!name.equals(key)) return true;
+				value = v;
+				found = true;
+				return false;
+			}
+		} finder = { key, value, false };
+		return enumDirectory(dir, finder) && finder.found;
+	}
+
+	// 言語 lang のリソースを検索（LANG_NEUTRAL 指定時は最初に見つかった言語）
+	bool find(const ResName &type, const ResName &name, WORD lang, ResData &data) const {
+		DWORD names = 0, langs = 0, value = 0;
+		if (!findDirectory(0, type, names) || !IsDirectory(names) ||
+			!findDirectory(Offset(names), name, langs) || !IsDirectory(langs)) return false;
+		if (!findDirectory(Offset(langs), ResName(lang), value)) {
+			if (lang != 0) return false;
+			struct First {
+				DWORD &value;
+				WORD lang;
+				bool found;
+				bool operator()(const ResName &name, DWORD v) {
+					value = v;
+					lang = name.id;
+					found = !name.isString();
+					return !found;
+				}
+			} first = { value, 0, false };
+			if (!enumDirectory(Offset(langs), first) || !first.found) return false;
+			lang = first.lang;
+		}
+		if (IsDirectory(value) || !getData(value, data)) return false;
+		data.lang = lang;
+		return true;
+	}
+
+	// 種類列挙: func(const ResName &type)
+	template <class F>
+	bool enumTypes(F &func) const {
+		EnumAdapter<F> adapter = { func };
+		return enumDirectory(0, adapter);
+	}
+	// 名前列挙: func(const ResName &name)
+	template <class F>
+	bool enumNames(const ResName &type, F &func) const {
+		DWORD names = 0;
+		if (!findDirectory(0, type, names) || !IsDirectory(names)) return false;
+		EnumAdapter<F> adapter = { func };
+		return enumDirectory(Offset(names), adapter);
+	}
+	// 言語列挙: func(const ResName &lang)
+	template <class F>
+	bool enumLangs(const ResName &type, const ResName &name, F &func) const {
+		DWORD names = 0, langs = 0;
+		if (!findDirectory(0, type, names) || !IsDirectory(names) ||
+			!findDirectory(Offset(names), name, langs) || !IsDirectory(langs)) return false;
+		EnumAdapter<F> adapter = { func };
+		return enumDirectory(Offset(langs), adapter);
+	}
+
+	// 全リソース走査: func(const ResName &type, const ResName &name, const ResData &data)
+	// func が false を返した時点で走査を打ち切る
+	template <class F>
+	bool enumAll(F &func) const {
+		struct Langs {
+			const Image &self; F &func; const ResName &type; const ResName &name; bool &cont;
+			bool operator()(const ResName &lang, DWORD value) {
+				ResData data;
+				if (lang.isString() || IsDirectory(value) || !self.getData(value, data)) return true; // 不正なエントリは無視
+				data.lang = lang.id;
+				return (cont = func(type, name, data));
+			}
+		};
+		struct Names {
+			const Image &self; F &func; const ResName &type; bool &cont;
+			bool operator()(const ResName &name, DWORD value) {
+				if (!IsDirectory(value)) return true;
+				Langs langs = { self, func, type, name, cont };
+				return self.enumDirectory(Offset(value), langs) && cont;
+			}
+		};
+		struct Types {
+			const Image &self; F &func; bool &cont;
+			bool operator()(const ResName &type, DWORD value) {
+				if (!IsDirectory(value)) return true;
+				Names names = { self, func, type, cont };
+				return self.enumDirectory(Offset(value), names) && cont;
+			}
+		};
+		bool cont = true;
+		Types types = { *this, func, cont };
+		return !hasResource() || enumDirectory(0, types);
+	}
+
+	static bool  IsDirectory(DWORD value) { return (value & 0x80000000UL) != 0; }
+	static DWORD Offset(DWORD value)      { return value & 0x7FFFFFFFUL; }
+
+private:
+	template <class F>
+	struct EnumAdapter {
+		F &func;
+		bool operator()(const ResName &name, DWORD) { return func(name); }
+	};
+
+	bool getEntryName(DWORD value, ResName &name) const {
+		if (!IsDirectory(value)) {
+			name = ResName((WORD)value);
+			return true;
+		}
+		const DWORD pos = Offset(value);
+		if ((size_t)pos + 2 > rsrcLen_) return false;
+		const size_t len = ReadU16(rsrc_ + pos);
+		if ((size_t)pos + 2 + len * 2 > rsrcLen_) return false;
+		name = ResName(reinterpret_cast<const char16_t*>(rsrc_ + pos + 2), len);
+		return true;
+	}
+	bool getData(DWORD pos, ResData &data) const {
+		if ((size_t)pos + 16 > rsrcLen_) return false;
+		const BYTE *p = rsrc_ + pos;
+		const DWORD rva  = ReadU32(p);
+		const DWORD size = ReadU32(p + 4);
+		size_t avail = 0;
+		const BYTE *ptr = fromRva(rva, &avail);
+		if (!ptr || avail < size) return false;
+		data.ptr = ptr;
+		data.size = size;
+		data.codepage = ReadU32(p + 8);
+		data.lang = 0;
+		data.entry = p;
+		return true;
+	}
+
+	const BYTE *base_;
+	size_t size_;
+	bool is64_;
+	size_t ntOffset_, optOffset_, secOffset_;
+	std::vector<Section> sections_;
+	DWORD rsrcRva_, rsrcSize_;
+	const BYTE *rsrc_;
+	size_t rsrcLen_;
+};
+
+//--------------------------------------------------------------
+// (type, name, lang) でソートされた平坦なリソース索引
+//   文字列名はインターンしてソート順の番号で持つため，比較は整数比較のみ
+class Index {
+public:
+	struct Record {
+		DWORD type, name;   // 文字列: インターン番号 / ID: KEY_ID|id
+		WORD  lang;
+		DWORD codepage;
+		const BYTE *ptr;
+		DWORD size;
+	};
+	enum { KEY_ID = 0x80000000UL, KEY_NONE = 0xFFFFFFFFUL };
+
+	Index() {}
+
+	void clear() {
+		records_.clear();
+		pool_.clear();
+		strings_.clear();
+	}
+	bool empty() const { return records_.empty(); }
+	size_t size() const { return records_.size(); }
+	const std::vector<Record>& records() const { return records_; }
+
+	bool build(const Image &image) {
+		clear();
+		struct Temp { ResName type, name; ResData data; };
+		std::vector<Temp> temp;
+		std::vector<ResName> names;
+		struct Collector {
+			std::vector<Temp> &temp;
+			std::vector<ResName> &names;
+			bool operator()(const ResName &type, const ResName &name, const ResData &data) {
+				Temp ent = { type, name, data };
+				temp.push_back(ent);
+				if (type.isString()) names.push_back(type);
+				if (name.isString()) names.push_back(name);
+				return true;
+			}
+		} collector = { temp, names };
+		if (!image.enumAll(collector)) return false;
+
+		// 文字列名のインターン（ソート順に番号付け）
+		std::sort(names.begin(), names.end(), [](const ResName &a, const ResName &b) { return ResName::Compare(a, b) < 0; });
+		names.erase(std::unique(names.begin(), names.end(), [](const ResName &a, const ResName &b) { return a.equals(b); }), names.end());
+		size_t total = 0;
+		for (auto it = names.cbegin(); it != names.cend(); ++it) total += it->len;
+		pool_.reserve(total);
+		strings_.reserve(names.size());
+		for (auto it = names.cbegin(); it != names.cend(); ++it) {
+			const Str str = { (DWORD)pool_.size(), (DWORD)it->len };
+			strings_.push_back(str);
+			pool_.append(it->str, it->len);
+		}
+
+		records_.reserve(temp.size());
+		for (auto it = temp.cbegin(); it != temp.cend(); ++it) {
+			const Record rec = { key(it->type), key(it->name), it->data.lang, it->data.codepage, it->data.ptr, it->data.size };
+			records_.push_back(rec);
+		}
+		std::sort(records_.begin(), records_.end(), Less);
+		return true;
+	}
+
+	// 検索キーへの変換（存在しない文字列名は KEY_NONE）
+	DWORD key(const ResName &res) const {
+		if (!res.isString()) return KEY_ID | res.id;
+		size_t lo = 0, hi = strings_.size();
+		while (lo < hi) {
+			const size_t mid = (lo + hi) / 2;
+			const int cmp = ResName::Compare(name(mid), res);
+			if (cmp == 0) return (DWORD)mid;
+			if (cmp < 0) lo = mid + 1;
+			else         hi = mid;
+		}
+		return KEY_NONE;
+	}
+	ResName name(DWORD key) const {
+		if (key & KEY_ID) return ResName((WORD)key);
+		const Str &str = strings_[key];
+		return ResName(pool_.c_str() + str.offset, str.len);
+	}
+
+	// 言語 lang のリソースを検索（LANG_NEUTRAL 指定時は最初に見つかった言語）
+	const Record* find(DWORD type, DWORD name, WORD lang) const {
+		if (type == KEY_NONE || name == KEY_NONE) return nullptr;
+		const Record query = { type, name, lang, 0, nullptr, 0 };
+		auto it = std::lower_bound(records_.begin(), records_.end(), query, Less);
+		if (it == records_.end() || it->type != type || it->name != name) return nullptr;
+		return (it->lang == lang || lang == 0) ? &(*it) : nullptr;
+	}
+	bool find(const ResName &type, const ResName &name, WORD lang, ResData &data) const {
+		const Record *rec = find(key(type), key(name), lang);
+		if (!rec) return false;
+		data.ptr = rec->ptr;
+		data.size = rec->size;
+		data.codepage = rec->codepage;
+		data.lang = rec->lang;
+		data.entry = nullptr;
+		return true;
+	}
+
+	// type / name が KEY_NONE 以外なら一致する範囲
+	typedef std::vector<Record>::const_iterator iterator;
+	void range(DWORD type, DWORD name, iterator &begin, iterator &end) const {
+		begin = records_.begin();
+		end   = records_.end();
+		if (type == KEY_NONE) return;
+		const Record lo = { type, (name == KEY_NONE) ? 0 : name, 0, 0, nullptr, 0 };
+		const Record hi = { type, (name == KEY_NONE) ? KEY_NONE : name, 0xFFFF, 0, nullptr, 0 };
+		begin = std::lower_bound(records_.begin(), records_.end(), lo, Less);
+		end   = std::upper_bound(begin, records_.end(), hi, Less);
+	}
+
+	// 種類列挙: func(const ResName &type)
+	template <class F>
+	void enumTypes(F &func) const {
+		for (auto it = records_.cbegin(); it != records_.cend(); ++it) {
+			if (it != records_.cbegin() && (it-1)->type == it->type) continue;
+			if (!func(name(it->type))) break;
+		}
+	}
+	// 名前列挙: func(const ResName &name)
+	template <class F>
+	void enumNames(const ResName &type, F &func) const {
+		const DWORD t = key(type);
+		if (t == KEY_NONE) return;
+		iterator begin, end;
+		range(t, KEY_NONE, begin, end);
+		for (auto it = begin; it != end; ++it) {
+			if (it != begin && (it-1)->name == it->name) continue;
+			if (!func(name(it->name))) break;
+		}
+	}
+	// 言語列挙: func(const ResName &lang)
+	template <class F>
+	void enumLangs(const ResName &type, const ResName &name, F &func) const {
+		const DWORD t = key(type), n = key(name);
+		if (t == KEY_NONE || n == KEY_NONE) return;
+		iterator begin, end;
+		range(t, n, begin, end);
+		for (auto it = begin; it != end; ++it) {
+			if (!func(ResName(it->lang))) break;
+		}
+	}
+
+private:
+	static bool Less(const Record &a, const Record &b) {
+		if (a.type != b.type) return a.type < b.type;
+		if (a.name != b.name) return a.name < b.name;
+		return a.lang < b.lang;
+	}
+	struct Str { DWORD offset, len; };
+
+	std::vector<Record> records_;
+	std::u16string pool_;
+	std::vector<Str> strings_;
+};
+
+//--------------------------------------------------------------
+// 書き出し用ファイル
+class OutputFile {
+public:
+	typedef FileMapping::PathChar PathChar;
+	OutputFile() :
+#ifdef _WIN32
+		handle_(INVALID_HANDLE_VALUE)
+#else
+		fd_(-1)
+#endif
+	{}
+	~OutputFile() { close(); }
+
+	// like を指定すると同じパーミッションで作成（POSIX のみ）
+	bool create(const PathChar *path, const PathChar *like = nullptr) {
+		close();
+#ifdef _WIN32
+		(void)like;
+		handle_ = ::CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		return handle_ != INVALID_HANDLE_VALUE;
+#else
+		struct stat st;
+		const mode_t mode = (like && ::stat(like, &st) == 0) ? (st.st_mode & 07777) : 0666;
+		fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+		if (fd_ >= 0 && like) ::fchmod(fd_, mode);
+		return fd_ >= 0;
+#endif
+	}
+	// 既存のファイルを読み書き用に開く
+	bool update(const PathChar *path) {
+		close();
+#ifdef _WIN32
+		handle_ = ::CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		return handle_ != INVALID_HANDLE_VALUE;
+#else
+		fd_ = ::open(path, O_RDWR);
+		return fd_ >= 0;
+#endif
+	}
+	bool read(void *ptr, size_t len) {
+		BYTE *p = static_cast<BYTE*>(ptr);
+		while (len > 0) {
+			const size_t step = (len > 0x40000000UL) ? 0x40000000UL : len;
+#ifdef _WIN32
+			DWORD done = 0;
+			if (!::ReadFile(handle_, p, (DWORD)step, &done, NULL) || done == 0) return false;
+#else
+			const ssize_t done = ::read(fd_, p, step);
+			if (done <= 0) return false;
+#endif
+			p   += done;
+			len -= done;
+		}
+		return true;
+	}
+	// ファイルサイズの変更（伸ばした部分の内容は不定）
+	bool resize(size_t size) {
+#ifdef _WIN32
+		return seek(size) && ::SetEndOfFile(handle_) != FALSE;
+#else
+		return ::ftruncate(fd_, (off_t)size) == 0;
+#endif
+	}
+	bool seek(size_t pos) {
+#ifdef _WIN32
+		LARGE_INTEGER li;
+		li.QuadPart = (LONGLONG)pos;
+		return ::SetFilePointerEx(handle_, li, NULL, FILE_BEGIN) != FALSE;
+#else
+		return ::lseek(fd_, (off_t)pos, SEEK_SET) == (off_t)pos;
+#endif
+	}
+	bool write(const void *ptr, size_t len) {
+		const BYTE *p = static_cast<const BYTE*>(ptr);
+		while (len > 0) {
+			const size_t step = (len > 0x40000000UL) ? 0x40000000UL : len;
+#ifdef _WIN32
+			DWORD done = 0;
+			if (!::WriteFile(handle_, p, (DWORD)step, &done, NULL) || done == 0) return false;
+#else
+			const ssize_t done = ::write(fd_, p, step);
+			if (done <= 0) return false;
+#endif
+			p   += done;
+			len -= done;
+		}
+		return true;
+	}
+	bool close() {
+		bool ok = true;
+#ifdef _WIN32
+		if (handle_ != INVALID_HANDLE_VALUE) ok = ::CloseHandle(handle_) != FALSE;
+		handle_ = INVALID_HANDLE_VALUE;
+#else
+		if (fd_ >= 0) ok = ::close(fd_) == 0;
+		fd_ = -1;
+#endif
+		return ok;
+	}
+
+	static bool Replace(const PathChar *from, const PathChar *to) {
+#ifdef _WIN32
+		return ::MoveFileExW(from, to, MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+		return ::rename(from, to) == 0;
+#endif
+	}
+	static void Remove(const PathChar *path) {
+#ifdef _WIN32
+		::DeleteFileW(path);
+#else
+		::unlink(path);
+#endif
+	}
+private:
+	OutputFile(const OutputFile&);
+	OutputFile& operator=(const OutputFile&);
+#ifdef _WIN32
+	HANDLE handle_;
+#else
+	int fd_;
+#endif
+};
+
+//--------------------------------------------------------------
+// 書き出し時に読み込むデータ（ファイル等）
+class Source {
+public:
+	virtual ~Source() {}
+	virtual bool   open() = 0;
+	virtual size_t read(BYTE *buf, size_t len) = 0; // 0:終端またはエラー
+	virtual void   close() = 0;
+};
+
+//--------------------------------------------------------------
+// 固定長バッファによる転送
+//   Source は TJS のストリームのこともあるので，読み込みは呼び出し元のスレッドで行う
+class ChunkPump {
+public:
+	enum { CHUNK = 1 << 20 };
+
+	ChunkPump() {}
+
+	template <class SINK>
+	bool copy(Source &src, size_t size, SINK &sink) {
+		if (size == 0) return true;
+		if (!src.open()) return false;
+		bool ok = true;
+		try {
+			if (buf_.empty()) buf_.resize(CHUNK);
+			for (size_t rest = size; ok && rest > 0; ) {
+				const size_t got = ReadFull(src, &buf_.front(), std::min(rest, (size_t)CHUNK));
+				if (got == 0) { ok = false; break; }
+				ok = sink.write(&buf_.front(), got);
+				rest -= got;
+			}
+		} catch (...) {
+			src.close();
+			throw;
+		}
+		src.close();
+		return ok;
+	}
+
+	template <class SINK>
+	static bool zero(SINK &sink, size_t len) {
+		static const BYTE zeros[4096] = {0};
+		while (len > 0) {
+			const size_t step = std::min(len, sizeof(zeros));
+			if (!sink.write(zeros, step)) return false;
+			len -= step;
+		}
+		return true;
+	}
+private:
+	static size_t ReadFull(Source &src, BYTE *buf, size_t len) {
+		size_t total = 0;
+		while (total < len) {
+			const size_t got = src.read(buf + total, len - total);
+			if (got == 0) break;
+			total += got;
+		}
+		return total;
+	}
+	std::vector<BYTE> buf_;
+};
+
+//--------------------------------------------------------------
+// 書き換え用リソースツリー
+class Tree {
+public:
+	struct Name {
+		bool named;
+		WORD id;
+		std::u16string str;
+
+		Name() : named(false), id(0) {}
+		Name(const ResName &res) : named(res.isString()), id(res.id) {
+			if (named) str.assign(res.str, res.len);
+		}
+		ResName ref() const { return named ? ResName(str.c_str(), str.length()) : ResName(id); }
+	};
+	typedef std::vector<BYTE> Payload;
+	typedef std::shared_ptr<const void> Holder;
+	struct Lang {
+		WORD  lang;
+		DWORD codepage;
+		const BYTE *ptr;                        // データ先頭（元ファイルのマッピングか hold 内）
+		DWORD size;
+		Holder hold;                            // 新規データの所有（Payload や octet の参照）
+		std::shared_ptr<Source> source;         // 書き出し時に読み込むデータ（ptr==nullptr）
+		bool loaded;                            // 元イメージにあったもの
+		bool pending;                           // 読み込み後に書き換えたもの
+	};
+	struct Node {
+		Name name;
+		std::vector<Lang> langs;
+	};
+	struct Type {
+		Name name;
+		std::vector<Node> names;
+	};
+
+	Tree() {}
+
+	void clear() { types_.clear(); removed_.clear(); }
+	bool empty() const { return types_.empty(); }
+	const std::vector<Type>& types() const { return types_; }
+
+	// 既存イメージのリソースを取り込む（データは元イメージを参照）
+	bool load(const Image &image) {
+		clear();
+		struct Loader {
+			Tree &self;
+			bool operator()(const ResName &type, const ResName &name, const ResData &data) {
+				Lang ent = { data.lang, data.codepage, data.ptr, data.size, Holder(), std::shared_ptr<Source>(), true, false };
+				self.insert(type, name, ent);
+				return true;
+			}
+		} loader = { *this };
+		return image.enumAll(loader);
+	}
+
+	// 同じ (type, name, lang) への書き込みは最後のものだけが残る
+	void set(const ResName &type, const ResName &name, WORD lang, const BYTE *ptr, DWORD size, const Holder &hold) {
+		Lang ent = { lang, 0, size ? ptr : nullptr, size, hold, std::shared_ptr<Source>(), false, true };
+		insert(type, name, ent);
+	}
+	void set(const ResName &type, const ResName &name, WORD lang, const std::shared_ptr<const Payload> &data) {
+		set(type, name, lang, data->empty() ? nullptr : &data->front(), (DWORD)data->size(), data);
+	}
+	void set(const ResName &type, const ResName &name, WORD lang, Payload &data) {
+		std::shared_ptr<Payload> hold = std::make_shared<Payload>();
+		hold->swap(data);
+		set(type, name, lang, hold);
+	}
+	void set(const ResName &type, const ResName &name, WORD lang, const std::shared_ptr<Source> &source, DWORD size) {
+		Lang ent = { lang, 0, nullptr, size, Holder(), source, false, true };
+		insert(type, name, ent);
+	}
+	bool remove(const ResName &type, const ResName &name, WORD lang) {
+		auto t = find(types_, type);
+		if (t == types_.end()) return false;
+		auto n = find(t->names, name);
+		if (n == t->names.end()) return false;
+		auto l = findLang(n->langs, lang);
+		if (l == n->langs.end() || l->lang != lang) return false;
+		if (l->loaded) {
+			const Removed key = { t->name, n->name, lang };
+			removed_.push_back(key);
+		}
+		n->langs.erase(l);
+		if (n->langs.empty()) t->names.erase(n);
+		if (t->names.empty()) types_.erase(t);
+		return true;
+	}
+
+	bool hasRemoved() const { return !removed_.empty(); }
+
+	// 全て削除
+	void removeAll() {
+		for (auto t = types_.cbegin(); t != types_.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) {
+					if (!l->loaded) continue;
+					const Removed key = { t->name, n->name, l->lang };
+					removed_.push_back(key);
+				}
+			}
+		}
+		types_.clear();
+	}
+
+	// 読み込み後の変更（同じ対象への変更はまとめて1件）
+	size_t pendingCount() const {
+		size_t count = removed_.size();
+		for (auto t = types_.cbegin(); t != types_.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) if (l->pending) ++count;
+			}
+		}
+		return count;
+	}
+	// 書き換えたデータの合計サイズ
+	size_t pendingBytes() const {
+		size_t total = 0;
+		for (auto t = types_.cbegin(); t != types_.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) if (l->pending) total += l->size;
+			}
+		}
+		return total;
+	}
+	// 書き出し時に読み込むデータがあるか
+	bool hasSource() const {
+		for (auto t = types_.cbegin(); t != types_.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) if (l->source) return true;
+			}
+		}
+		return false;
+	}
+
+	// [base, base+len) を参照しているデータを1つのバッファに写して参照先を移す
+	//   元ファイルを直接書き換える前に使う（写すのは参照されている範囲だけ）
+	size_t detach(const BYTE *base, size_t len) {
+		typedef std::pair<const BYTE*, const BYTE*> Range;
+		std::vector<Range> ranges;
+		for (auto t = types_.cbegin(); t != types_.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) {
+					if (l->size && l->ptr && l->ptr >= base && l->ptr < base + len) ranges.push_back(Range(l->ptr, l->ptr + l->size));
+				}
+			}
+		}
+		if (ranges.empty()) return 0;
+		// 重なり・隣接する範囲をまとめる
+		std::sort(ranges.begin(), ranges.end());
+		size_t count = 0;
+		for (size_t n = 1; n < ranges.size(); ++n) {
+			if (ranges[n].first <= ranges[count].second) ranges[count].second = std::max(ranges[count].second, ranges[n].second);
+			else ranges[++count] = ranges[n];
+		}
+		ranges.resize(count + 1);
+		std::vector<size_t> offsets;
+		size_t total = 0;
+		for (auto it = ranges.cbegin(); it != ranges.cend(); ++it) { offsets.push_back(total); total += it->second - it->first; }
+
+		std::shared_ptr<Payload> copy = std::make_shared<Payload>();
+		copy->reserve(total);
+		for (auto it = ranges.cbegin(); it != ranges.cend(); ++it) copy->insert(copy->end(), it->first, it->second);
+		for (auto t = types_.begin(); t != types_.end(); ++t) {
+			for (auto n = t->names.begin(); n != t->names.end(); ++n) {
+				for (auto l = n->langs.begin(); l != n->langs.end(); ++l) {
+					if (!l->ptr || l->ptr < base || l->ptr >= base + len) continue;
+					if (!l->size) { l->ptr = nullptr; continue; }
+					const size_t idx = std::upper_bound(ranges.begin(), ranges.end(), Range(l->ptr, l->ptr + l->size),
+						[](const Range &a, const Range &b) { return a.first < b.first; }) - ranges.begin() - 1;
+					l->ptr  = &copy->front() + offsets[idx] + (l->ptr - ranges[idx].first);
+					l->hold = copy;
+				}
+			}
+		}
+		return total;
+	}
+
+	// 検索（見つからなければ nullptr）
+	const Type* lookup(const ResName &type) const {
+		std::vector<Type> &list = const_cast<std::vector<Type>&>(types_);
+		auto t = find(list, type);
+		return (t != list.end()) ? &(*t) : nullptr;
+	}
+	const Lang* lookup(const ResName &type, const ResName &name, WORD lang) const {
+		const Type *t = lookup(type);
+		if (!t) return nullptr;
+		std::vector<Node> &names = const_cast<std::vector<Node>&>(t->names);
+		auto n = find(names, name);
+		if (n == names.end()) return nullptr;
+		auto l = findLang(n->langs, lang);
+		return (l != n->langs.end() && l->lang == lang) ? &(*l) : nullptr;
+	}
+
+private:
+	template <class V>
+	static typename std::vector<V>::iterator find(std::vector<V> &list, const ResName &key) {
+		auto it = lower(list, key);
+		return (it != list.end() && ResName::Compare(it->name.ref(), key) == 0) ? it : list.end();
+	}
+	template <class V>
+	static typename std::vector<V>::iterator lower(std::vector<V> &list, const ResName &key) {
+		return std::lower_bound(list.begin(), list.end(), key, [](const V &v, const ResName &k) { return ResName::Compare(v.name.ref(), k) < 0; });
+	}
+	static std::vector<Lang>::iterator findLang(std::vector<Lang> &list, WORD lang) {
+		return std::lower_bound(list.begin(), list.end(), lang, [](const Lang &v, WORD k) { return v.lang < k; });
+	}
+
+	void insert(const ResName &type, const ResName &name, const Lang &ent) {
+		auto t = lower(types_, type);
+		if (t == types_.end() || ResName::Compare(t->name.ref(), type) != 0) {
+			t = types_.insert(t, Type());
+			t->name = Name(type);
+		}
+		auto n = lower(t->names, name);
+		if (n == t->names.end() || ResName::Compare(n->name.ref(), name) != 0) {
+			n = t->names.insert(n, Node());
+			n->name = Name(name);
+		}
+		auto l = findLang(n->langs, ent.lang);
+		if (l != n->langs.end() && l->lang == ent.lang) {
+			const DWORD codepage = l->codepage;
+			const bool loaded = l->loaded;
+			*l = ent;
+			if (!ent.codepage) l->codepage = codepage;
+			l->loaded = loaded;
+		} else {
+			l = n->langs.insert(l, ent);
+			// 削除済みの元データを書き直した場合
+			for (auto it = removed_.begin(); it != removed_.end(); ++it) {
+				if (it->lang == ent.lang &&
+					ResName::Compare(it->type.ref(), type) == 0 &&
+					ResName::Compare(it->name.ref(), name) == 0) {
+					removed_.erase(it);
+					l->loaded = true;
+					break;
+				}
+			}
+		}
+	}
+
+	struct Removed {
+		Name type, name;
+		WORD lang;
+	};
+	std::vector<Type> types_;
+	std::vector<Removed> removed_; // 削除した元データ
+};
+
+//--------------------------------------------------------------
+// .rsrc セクションの組み立て
+//   [ディレクトリ群][名前文字列][IMAGE_RESOURCE_DATA_ENTRY群][データ]
+class Builder {
+public:
+	Builder(const Tree &tree) : tree_(tree) { dedup(); layout(); }
+
+	size_t size() const { return total_; }
+	// 同じ内容のデータを共有して減らしたバイト数
+	size_t saved() const { return saved_; }
+
+	// size() バイトを先頭から順に書き出す（va はセクションの RVA）
+	template <class SINK>
+	bool emit(SINK &sink, DWORD va, ChunkPump &pump) const {
+		std::vector<BYTE> head(entryEnd_, 0);
+		BYTE *out = &head.front();
+		const std::vector<Tree::Type> &types = tree_.types();
+		size_t dir = 0, typedir = rootSize_, namedir = typedirEnd_;
+		size_t str = dirEnd_, entry = strEnd_, index = 0;
+
+		dir = putDirectory(out, dir, types.size(), CountNamed(types));
+		for (auto t = types.cbegin(); t != types.cend(); ++t) {
+			dir = putEntry(out, dir, t->name, str, typedir, true);
+			typedir = putDirectory(out, typedir, t->names.size(), CountNamed(t->names));
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				typedir = putEntry(out, typedir, n->name, str, namedir, true);
+				namedir = putDirectory(out, namedir, n->langs.size(), 0);
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) {
+					Tree::Name lang;
+					lang.id = l->lang;
+					namedir = putEntry(out, namedir, lang, str, entry, false);
+					PutU32(out + entry +  0, va + (DWORD)(entryEnd_ + offset_[index++]));
+					PutU32(out + entry +  4, l->size);
+					PutU32(out + entry +  8, l->codepage);
+					entry += 16;
+				}
+			}
+		}
+		if (!sink.write(out, head.size())) return false;
+
+		// データ本体（共有されるものは最初の1回だけ）
+		index = 0;
+		for (auto t = types.cbegin(); t != types.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l, ++index) {
+					if (share_[index] != index) continue;
+					bool ok = true;
+					if      (l->source)   ok = pump.copy(*l->source, l->size, sink);
+					else if (l->size > 0) ok = sink.write(l->ptr, l->size);
+					if (!ok || !ChunkPump::zero(sink, Align(l->size, 8) - l->size)) return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	static size_t Align(size_t pos, size_t align) { return (pos + align - 1) & ~(align - 1); }
+	static void PutU16(BYTE *p, WORD  v) { p[0] = (BYTE)v; p[1] = (BYTE)(v >> 8); }
+	static void PutU32(BYTE *p, DWORD v) { PutU16(p, (WORD)v); PutU16(p + 2, (WORD)(v >> 16)); }
+
+private:
+	template <class V>
+	static size_t CountNamed(const std::vector<V> &list) {
+		size_t count = 0;
+		for (auto it = list.cbegin(); it != list.cend() && it->name.named; ++it) ++count;
+		return count;
+	}
+	static size_t putDirectory(BYTE *out, size_t pos, size_t count, size_t named) {
+		PutU16(out + pos + 12, (WORD)named);
+		PutU16(out + pos + 14, (WORD)(count - named));
+		return pos + 16;
+	}
+	static size_t putEntry(BYTE *out, size_t pos, const Tree::Name &name, size_t &str, size_t child, bool subdir) {
+		if (name.named) {
+			PutU32(out + pos, 0x80000000UL | (DWORD)str);
+			PutU16(out + str, (WORD)name.str.length());
+			for (size_t n = 0; n < name.str.length(); ++n) PutU16(out + str + 2 + n * 2, (WORD)name.str[n]);
+			str += 2 + name.str.length() * 2;
+		} else {
+			PutU32(out + pos, name.id);
+		}
+		PutU32(out + pos + 4, subdir ? (0x80000000UL | (DWORD)child) : (DWORD)child);
+		return pos + 8;
+	}
+
+	// 同じ内容のデータを探して share_[n] に共有元の番号を入れる
+	//   書き出し時に読み込むもの（source）は対象外
+	void dedup() {
+		struct Item {
+			size_t size;
+			std::uint64_t hash;
+			size_t index;
+			const BYTE *ptr;
+			bool operator<(const Item &o) const {
+				return size != o.size ? size < o.size : hash != o.hash ? hash < o.hash : index < o.index;
+			}
+		};
+		std::vector<Item> items;
+		const std::vector<Tree::Type> &types = tree_.types();
+		size_t index = 0;
+		for (auto t = types.cbegin(); t != types.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l, ++index) {
+					share_.push_back(index);
+					if (l->source || !l->ptr || !l->size) continue;
+					const Item item = { l->size, 0, index, l->ptr };
+					items.push_back(item);
+				}
+			}
+		}
+		// 同じサイズが他に無いものはハッシュを計算しない
+		std::sort(items.begin(), items.end());
+		for (size_t i = 0; i < items.size(); ) {
+			size_t j = i + 1;
+			while (j < items.size() && items[j].size == items[i].size) ++j;
+			if (j - i > 1) {
+				for (size_t k = i; k < j; ++k) items[k].hash = ContentHash::Calc(items[k].ptr, items[k].size);
+				std::sort(items.begin() + i, items.begin() + j);
+				for (size_t k = i + 1; k < j; ++k) {
+					// 同じハッシュの中で内容が一致する最初のものを共有元にする
+					for (size_t m = i; m < k; ++m) {
+						if (items[m].hash != items[k].hash || share_[items[m].index] != items[m].index) continue;
+						if (items[m].ptr == items[k].ptr || memcmp(items[m].ptr, items[k].ptr, items[k].size) == 0) {
+							share_[items[k].index] = items[m].index;
+							break;
+						}
+					}
+				}
+			}
+			i = j;
+		}
+	}
+
+	void layout() {
+		const std::vector<Tree::Type> &types = tree_.types();
+		size_t typedirs = 0, namedirs = 0, strings = 0, entries = 0, data = 0, index = 0;
+		saved_ = 0;
+		offset_.assign(share_.size(), 0);
+		for (auto t = types.cbegin(); t != types.cend(); ++t) {
+			if (t->name.named) strings += 2 + t->name.str.length() * 2;
+			typedirs += 16 + 8 * t->names.size();
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				if (n->name.named) strings += 2 + n->name.str.length() * 2;
+				namedirs += 16 + 8 * n->langs.size();
+				entries += 16 * n->langs.size();
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l, ++index) {
+					if (share_[index] != index) {
+						offset_[index] = offset_[share_[index]]; // 共有元は必ず前にある
+						saved_ += Align(l->size, 8);
+						continue;
+					}
+					offset_[index] = data;
+					data = Align(data + l->size, 8);
+				}
+			}
+		}
+		rootSize_   = 16 + 8 * types.size();
+		typedirEnd_ = rootSize_ + typedirs;
+		dirEnd_     = typedirEnd_ + namedirs;
+		strEnd_     = Align(dirEnd_ + strings, 8);
+		entryEnd_   = strEnd_ + entries;
+		total_      = entryEnd_ + data;
+	}
+
+	const Tree &tree_;
+	size_t rootSize_, typedirEnd_, dirEnd_, strEnd_, entryEnd_, total_;
+	std::vector<size_t> share_;  // 各データの共有元の番号（自分自身なら共有なし）
+	std::vector<size_t> offset_; // 各データの entryEnd_ からの位置
+	size_t saved_;
+};
+
+//--------------------------------------------------------------
+// リソースを差し替えたイメージの書き出し
+class Writer {
+public:
+	typedef FileMapping::PathChar PathChar;
+	enum Error {
+		ERR_NONE = 0,
+		ERR_OPEN,     // ファイルが開けない
+		ERR_FORMAT,   // PE ファイルではない
+		ERR_LAYOUT,   // セクションを配置できない
+		ERR_WRITE,    // 書き込み失敗
+	};
+
+	// 新しい .rsrc の配置
+	struct Layout {
+		enum Mode {
+			TAIL,     // .rsrc が最後のセクションなので伸縮する
+			INPLACE,  // 既存の .rsrc の領域に収まる
+			APPEND,   // 最後尾に新しいセクションを追加する
+		} mode;
+		DWORD  va;
+		size_t size;     // .rsrc の実サイズ
+		size_t pos;      // 出力ファイル上の .rsrc の位置
+		size_t slot;     // 出力ファイル上の .rsrc の領域サイズ
+		size_t overlay;  // 元ファイルのセクション外末尾データの位置
+		size_t resume;   // .rsrc の後に続ける元ファイルの位置
+		size_t cut, cutSize; // resume 以降で取り除く元ファイルの範囲（署名）
+		size_t sumpos;   // CheckSum のファイル位置（0なら更新しない）
+		std::vector<BYTE> header; // 修正済みヘッダ（元ファイル先頭の置き換え）
+
+		// resume 以降に続ける元ファイルの範囲（最大2つ）
+		size_t tail(size_t end, size_t pos[2], size_t len[2]) const {
+			const size_t from = std::min(resume, end);
+			size_t count = 0;
+			if (cutSize && cut >= from && cut + cutSize <= end) {
+				if (cut > from)            { pos[count] = from;            len[count++] = cut - from; }
+				if (cut + cutSize < end)   { pos[count] = cut + cutSize;   len[count++] = end - cut - cutSize; }
+			} else if (from < end)         { pos[count] = from;            len[count++] = end - from; }
+			return count;
+		}
+	};
+
+	Writer() : error_(ERR_NONE), saved_(0), strip_(false), clean_(false) {}
+
+	bool open(const PathChar *path, bool clean) {
+		close();
+		if (!map_.open(path)) return fail(ERR_OPEN);
+		if (!image_.load(map_.data(), map_.size())) {
+			close();
+			return fail(ERR_FORMAT);
+		}
+		path_ = path;
+		clean_ = clean;
+		tree_.load(image_);
+		if (clean) tree_.removeAll();
+		return true;
+	}
+	// open 後の変更を全て取り消す（clean で開いた場合は全て削除した状態に戻る）
+	void rollback() {
+		if (!isOpen()) return;
+		tree_.load(image_);
+		if (clean_) tree_.removeAll();
+	}
+	void close() {
+		tree_.clear();
+		image_.clear();
+		map_.close();
+		path_.clear();
+	}
+	bool isOpen() const { return map_.isOpen(); }
+	Error lastError() const { return error_; }
+	// 書き出し時に証明書テーブル（Authenticode 署名）を取り除く
+	void setStripSignature(bool strip) { strip_ = strip; }
+	bool getStripSignature() const { return strip_; }
+	// 直前の commit で同じ内容のデータを共有して減らしたバイト数
+	size_t savedBytes() const { return saved_; }
+
+	Tree& tree() { return tree_; }
+	const Tree& tree() const { return tree_; }
+
+	// 新しい .rsrc を組み立てて一時ファイルに書き出し，元ファイルと置き換える
+	//   変更が全て元のデータ領域に収まる場合はその部分だけを直接書き換える
+	//   .rsrc の位置が変わらない場合も一時ファイルを使わず元ファイルを直接書き換える（rewrite）
+	bool commit() {
+		std::vector<Patch> patches;
+		if (planPatch(patches)) {
+			saved_ = 0;
+			return patch(patches);
+		}
+		const Builder builder(tree_);
+		saved_ = builder.saved();
+		Layout layout;
+		if (!Plan(image_, builder, tree_.empty(), layout, strip_)) return fail(ERR_LAYOUT);
+		// writeFromFile のデータは読み込みに失敗し得るので一時ファイルを経由する
+		if (layout.mode != Layout::APPEND && !tree_.hasSource()) return rewrite(builder, layout);
+
+		std::basic_string<PathChar> temp(path_);
+		temp += PathChar('.'); temp += PathChar('t'); temp += PathChar('m'); temp += PathChar('p');
+		OutputFile file;
+		if (!file.create(temp.c_str(), path_.c_str())) return fail(ERR_WRITE);
+		bool ok = false;
+		try {
+			ChunkPump pump;
+			CheckSum sum;
+			Tee<OutputFile> tee = { file, sum, 0 };
+			ok = (Emit(image_, builder, layout, pump, tee) &&
+				  WriteCheckSum(file, layout, sum.value(), tee.size));
+		} catch (...) {
+			file.close();
+			OutputFile::Remove(temp.c_str());
+			throw;
+		}
+		if (!file.close() || !ok) {
+			OutputFile::Remove(temp.c_str());
+			return fail(ERR_WRITE);
+		}
+		const std::basic_string<PathChar> path(path_);
+		close(); // マッピングを解放してから置き換え
+		if (!OutputFile::Replace(temp.c_str(), path.c_str())) {
+			OutputFile::Remove(temp.c_str());
+			return fail(ERR_WRITE);
+		}
+		return true;
+	}
+
+	// 配置の決定とヘッダの修正
+	static bool Plan(const Image &image, const Builder &builder, bool empty, Layout &layout, bool strip = false) {
+		const std::vector<Image::Section> &sections = image.sections();
+		const DWORD falign = image.getOptional(Image::OPT_FILE_ALIGNMENT);
+		const DWORD salign = image.getOptional(Image::OPT_SECTION_ALIGNMENT);
+		if (!falign || (falign & (falign - 1)) || !salign || (salign & (salign - 1))) return false;
+
+		// 各セクションの末尾（RVA とファイル位置）
+		size_t rawEnd = image.getOptional(Image::OPT_SIZE_OF_HEADERS);
+		DWORD vaEnd = 0;
+		int last = -1, target = -1;
+		const DWORD rsrc = image.resourceRva();
+		for (size_t n = 0; n < sections.size(); ++n) {
+			const Image::Section &sec = sections[n];
+			const DWORD vsize = sec.VirtualSize ? sec.VirtualSize : sec.SizeOfRawData;
+			if (sec.VirtualAddress + vsize >= vaEnd) { vaEnd = sec.VirtualAddress + vsize; last = (int)n; }
+			if (sec.SizeOfRawData) rawEnd = std::max(rawEnd, (size_t)sec.PointerToRawData + sec.SizeOfRawData);
+			if (rsrc && rsrc >= sec.VirtualAddress && rsrc - sec.VirtualAddress < vsize) target = (int)n;
+		}
+		if (rawEnd > image.size()) rawEnd = image.size();
+
+		const size_t size = builder.size();
+		layout.size = size;
+		layout.mode = Layout::APPEND;
+		if (target >= 0 && rsrc == sections[target].VirtualAddress) {
+			const Image::Section &sec = sections[target];
+			if (target == last && (size_t)sec.PointerToRawData + sec.SizeOfRawData >= rawEnd) {
+				layout.mode = Layout::TAIL;
+			} else {
+				DWORD gap = 0xFFFFFFFFUL;
+				for (size_t n = 0; n < sections.size(); ++n) {
+					if (sections[n].VirtualAddress > sec.VirtualAddress) gap = std::min(gap, sections[n].VirtualAddress - sec.VirtualAddress);
+				}
+				if (size <= sec.SizeOfRawData && size <= gap) layout.mode = Layout::INPLACE;
+			}
+		}
+
+		size_t secpos;
+		if (layout.mode == Layout::APPEND) {
+			secpos = image.sectionTableOffset() + sections.size() * 40;
+			size_t limit = image.getOptional(Image::OPT_SIZE_OF_HEADERS);
+			for (auto it = sections.cbegin(); it != sections.cend(); ++it) {
+				if (it->SizeOfRawData) limit = std::min(limit, (size_t)it->PointerToRawData);
+			}
+			if (secpos + 40 > limit) return false; // セクションヘッダの空きが無い
+			layout.va  = (DWORD)Builder::Align(vaEnd, salign);
+			layout.pos = Builder::Align(rawEnd, falign);
+		} else {
+			const Image::Section &sec = sections[target];
+			secpos = image.sectionTableOffset() + target * 40;
+			layout.va  = sec.VirtualAddress;
+			layout.pos = sec.PointerToRawData;
+		}
+		layout.overlay = rawEnd;
+		layout.slot    = (layout.mode == Layout::INPLACE) ? sections[target].SizeOfRawData : Builder::Align(size, falign);
+		layout.resume  = (layout.mode == Layout::INPLACE) ? layout.pos + layout.slot : rawEnd;
+
+		// ヘッダ修正
+		const size_t hdrlen = std::min(std::min(secpos + 40, layout.pos), image.size());
+		std::vector<BYTE> &head = layout.header;
+		head.assign(image.base(), image.base() + hdrlen);
+		BYTE *dst = &head.front();
+		BYTE *sec = dst + secpos;
+		const size_t optpos = image.optionalHeaderOffset();
+		if (layout.mode == Layout::APPEND) {
+			memset(sec, 0, 40);
+			memcpy(sec, ".rsrc\0\0\0", 8);
+			Builder::PutU32(sec + 12, layout.va);
+			Builder::PutU32(sec + 20, (DWORD)layout.pos);
+			Builder::PutU32(sec + 36, 0x40000040UL); // INITIALIZED_DATA | MEM_READ
+			Builder::PutU16(dst + image.fileHeaderOffset() + 2, (WORD)(sections.size() + 1)); // NumberOfSections
+		}
+		const DWORD oldraw = (layout.mode == Layout::APPEND) ? 0 : sections[target].SizeOfRawData;
+		Builder::PutU32(sec +  8, (DWORD)size);
+		Builder::PutU32(sec + 16, (DWORD)layout.slot);
+		const DWORD initdata = image.getOptional(Image::OPT_SIZE_OF_INITDATA);
+		Builder::PutU32(dst + optpos + Image::OPT_SIZE_OF_INITDATA, initdata + (DWORD)layout.slot - oldraw);
+		const size_t imgend = (layout.mode == Layout::TAIL) ? (size_t)layout.va + size : std::max((size_t)vaEnd, (size_t)layout.va + size);
+		Builder::PutU32(dst + optpos + Image::OPT_SIZE_OF_IMAGE, (DWORD)Builder::Align(imgend, salign));
+		// CheckSum は書き出しながら計算し直す（元が0なら未使用なのでそのまま）
+		layout.sumpos = 0;
+		if (image.getOptional(Image::OPT_CHECKSUM)) {
+			layout.sumpos = optpos + Image::OPT_CHECKSUM;
+			Builder::PutU32(dst + layout.sumpos, 0);
+		}
+		const size_t dirpos = image.dataDirectoryOffset(Image::DIR_RESOURCE);
+		Builder::PutU32(dst + dirpos,     empty ? 0 : layout.va);
+		Builder::PutU32(dst + dirpos + 4, empty ? 0 : (DWORD)size);
+
+		// 証明書テーブルはファイル位置指定なので末尾データと一緒にずらす（strip なら取り除く）
+		layout.cut = layout.cutSize = 0;
+		DWORD certpos = 0, certsize = 0;
+		if (image.getDataDirectory(Image::DIR_SECURITY, certpos, certsize) && certsize && certpos >= layout.resume && (size_t)certpos + certsize <= image.size()) {
+			const size_t secdir = image.dataDirectoryOffset(Image::DIR_SECURITY);
+			if (strip) {
+				layout.cut     = certpos;
+				layout.cutSize = certsize;
+				Builder::PutU32(dst + secdir,     0);
+				Builder::PutU32(dst + secdir + 4, 0);
+			} else {
+				Builder::PutU32(dst + secdir, (DWORD)(certpos - layout.resume + layout.pos + layout.slot));
+			}
+		}
+		return true;
+	}
+
+	// 配置に従って先頭から順に書き出す
+	//   元ファイルの部分もチャンク単位で渡すので，一度に触れるマッピングの範囲は一定
+	template <class SINK>
+	static bool Emit(const Image &image, const Builder &builder, const Layout &layout, ChunkPump &pump, SINK &sink) {
+		const BYTE *src = image.base();
+		const size_t hdrlen = layout.header.size();
+		const size_t head = std::min(layout.pos, layout.overlay);
+		if (!(sink.write(&layout.header.front(), hdrlen) &&
+			  (head <= hdrlen || Copy(sink, src + hdrlen, head - hdrlen)) &&
+			  ChunkPump::zero(sink, layout.pos - std::max(head, hdrlen)) &&
+			  builder.emit(sink, layout.va, pump) &&
+			  ChunkPump::zero(sink, layout.slot - layout.size))) return false;
+		size_t pos[2], len[2];
+		const size_t count = layout.tail(image.size(), pos, len);
+		for (size_t n = 0; n < count; ++n) if (!Copy(sink, src + pos[n], len[n])) return false;
+		return true;
+	}
+	// 書き出しながら CheckSum を計算する
+	template <class SINK>
+	struct Tee {
+		SINK &sink;
+		CheckSum &sum;
+		size_t size;
+		bool write(const void *ptr, size_t len) {
+			size += len;
+			return sum.write(ptr, len) && sink.write(ptr, len);
+		}
+	};
+	static bool WriteCheckSum(OutputFile &file, const Layout &layout, WORD sum, size_t filesize) {
+		if (!layout.sumpos) return true;
+		BYTE value[4];
+		Builder::PutU32(value, CheckSum::Complete(sum, filesize));
+		return file.seek(layout.sumpos) && file.write(value, sizeof(value));
+	}
+	template <class SINK>
+	static bool Copy(SINK &sink, const BYTE *ptr, size_t len) {
+		for (size_t done = 0; done < len; ) {
+			const size_t step = std::min(len - done, (size_t)ChunkPump::CHUNK);
+			if (!sink.write(ptr + done, step)) return false;
+			done += step;
+		}
+		return true;
+	}
+
+private:
+	bool fail(Error err) { error_ = err; return false; }
+
+	// 元のデータ領域への直接書き込み
+	struct Patch {
+		size_t pos;       // データのファイル位置
+		size_t slot;      // 元のデータサイズ
+		const BYTE *ptr;  // 新しいデータ
+		DWORD size;
+		size_t entry;     // IMAGE_RESOURCE_DATA_ENTRY のファイル位置
+	};
+	bool planPatch(std::vector<Patch> &patches) const {
+		if (tree_.hasRemoved()) return false;
+		DWORD certpos = 0, certsize = 0;
+		if (strip_ && image_.getDataDirectory(Image::DIR_SECURITY, certpos, certsize) && certsize) return false;
+		const BYTE *const base = image_.base();
+		const std::vector<Tree::Type> &types = tree_.types();
+		for (auto t = types.cbegin(); t != types.cend(); ++t) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) {
+					if (!l->pending) continue;
+					if (!l->loaded || l->source) return false;
+					ResData orig;
+					if (!image_.find(t->name.ref(), n->name.ref(), l->lang, orig) || orig.lang != l->lang || l->size > orig.size) return false;
+					const Patch p = { (size_t)(orig.ptr - base), orig.size, l->ptr, l->size, (size_t)(orig.entry - base) };
+					patches.push_back(p);
+				}
+			}
+		}
+		if (patches.empty()) return false;
+
+		// 他のエントリとデータ領域を共有していないこと
+		struct Shared {
+			const std::vector<Patch> &patches;
+			const BYTE *base;
+			bool found;
+			bool operator()(const ResName&, const ResName&, const ResData &data) {
+				const size_t pos = data.ptr - base, entry = data.entry - base;
+				for (auto it = patches.cbegin(); it != patches.cend(); ++it) {
+					if (it->entry != entry && pos < it->pos + it->slot && it->pos < pos + data.size) return !(found = true);
+				}
+				return true;
+			}
+		} shared = { patches, base, false };
+		image_.enumAll(shared);
+		return !shared.found;
+	}
+	bool patch(const std::vector<Patch> &patches) {
+		// CheckSum は書き換える範囲の差分だけで更新する（元の値が正しい前提）
+		const size_t sumpos = image_.optionalHeaderOffset() + Image::OPT_CHECKSUM;
+		const DWORD stored = image_.getOptional(Image::OPT_CHECKSUM);
+		const bool update = stored && stored >= image_.size() && stored - image_.size() <= 0xFFFF;
+		WORD sum = (WORD)(stored - image_.size());
+		for (auto it = patches.cbegin(); update && it != patches.cend(); ++it) {
+			BYTE size[4];
+			Builder::PutU32(size, it->size);
+			CheckSum olddata(it->pos), newdata(it->pos), oldsize(it->entry + 4), newsize(it->entry + 4);
+			olddata.write(image_.base() + it->pos, it->slot);
+			newdata.write(it->ptr, it->size);
+			oldsize.write(image_.base() + it->entry + 4, 4);
+			newsize.write(size, sizeof(size));
+			sum = CheckSum::Replace(CheckSum::Replace(sum, olddata.value(), newdata.value()), oldsize.value(), newsize.value());
+		}
+		const size_t filesize = image_.size();
+		const std::basic_string<PathChar> path(path_);
+		// 書き込みのためにマッピングを解放（新しいデータは tree_ が保持している）
+		image_.clear();
+		map_.close();
+		OutputFile file;
+		bool ok = file.update(path.c_str());
+		for (auto it = patches.cbegin(); ok && it != patches.cend(); ++it) {
+			BYTE size[4];
+			Builder::PutU32(size, it->size);
+			ok = (file.seek(it->pos) && file.write(it->ptr, it->size) &&
+				  ChunkPump::zero(file, it->slot - it->size) && // 残りは消しておく
+				  file.seek(it->entry + 4) && file.write(size, sizeof(size)));
+		}
+		if (ok && update) {
+			BYTE value[4];
+			Builder::PutU32(value, CheckSum::Complete(sum, filesize));
+			ok = file.seek(sumpos) && file.write(value, sizeof(value));
+		}
+		ok = file.close() && ok;
+		close();
+		return ok || fail(ERR_WRITE);
+	}
+
+	// .rsrc の位置が変わらない配置（TAIL/INPLACE）は元ファイルを直接書き換える
+	//   後ろのデータだけを移動してファイルサイズを伸縮するので，書き込み量は .rsrc と末尾データ分で済む
+	//   一時ファイルを使わないので，途中で書き込みに失敗すると元ファイルは壊れたままになる
+	bool rewrite(const Builder &builder, const Layout &layout) {
+		size_t pos[2], len[2], dst[2];
+		const size_t count = layout.tail(image_.size(), pos, len);
+		size_t end = layout.pos + layout.slot;
+		for (size_t n = 0; n < count; ++n) { dst[n] = end; end += len[n]; }
+
+		// CheckSum は書き出す内容の並び（Emit と同じ）で計算する
+		//   .rsrc 以外は元ファイルのマッピングから，.rsrc は書き出しながら
+		CheckSum sum;
+		if (layout.sumpos) {
+			const BYTE *src = image_.base();
+			const size_t hdrlen = layout.header.size();
+			const size_t head = std::min(layout.pos, layout.overlay);
+			sum.write(&layout.header.front(), hdrlen);
+			if (head > hdrlen) sum.write(src + hdrlen, head - hdrlen);
+			for (size_t n = 0; n < count; ++n) {
+				CheckSum part(dst[n]);
+				part.write(src + pos[n], len[n]);
+				sum.merge(part);
+			}
+		}
+		// 元ファイルを参照しているデータは参照されている範囲だけをメモリに写しておく
+		tree_.detach(image_.base(), image_.size());
+		const size_t oldsize = image_.size();
+		const std::basic_string<PathChar> path(path_);
+		image_.clear();
+		map_.close();
+		OutputFile file;
+		bool ok = (file.update(path.c_str()) &&
+				   (end <= oldsize || file.resize(end))); // 伸ばす場合は先に領域を確保
+		// 後ろへずらすものは後ろから，前へずらすものは前から移動する
+		for (size_t n = count; ok && n-- > 0; ) if (dst[n] > pos[n]) ok = MoveRange(file, pos[n], dst[n], len[n]);
+		for (size_t n = 0; ok && n < count; ++n) if (dst[n] <= pos[n]) ok = MoveRange(file, pos[n], dst[n], len[n]);
+		if (ok) {
+			// 空いた .rsrc の領域へ直接書き出す
+			ChunkPump pump;
+			CheckSum rsrc(layout.pos);
+			Tee<OutputFile> tee = { file, rsrc, 0 };
+			ok = (file.seek(0) && file.write(&layout.header.front(), layout.header.size()) &&
+				  file.seek(layout.pos) &&
+				  builder.emit(tee, layout.va, pump) &&
+				  ChunkPump::zero(tee, layout.slot - layout.size));
+			sum.merge(rsrc);
+		}
+		ok = (ok &&
+			  WriteCheckSum(file, layout, sum.value(), end) &&
+			  (end >= oldsize || file.resize(end)));
+		ok = file.close() && ok;
+		close();
+		return ok || fail(ERR_WRITE);
+	}
+	// ファイル内で len バイトを from から to へ移動する（重なっていてもよい）
+	//   copy_file_range 等は同じファイル内の重なった範囲を扱えないので固定長バッファで移す
+	static bool MoveRange(OutputFile &file, size_t from, size_t to, size_t len) {
+		if (from == to || len == 0) return true;
+		std::vector<BYTE> buf(std::min(len, (size_t)ChunkPump::CHUNK));
+		for (size_t done = 0; done < len; ) {
+			const size_t step = std::min(buf.size(), len - done);
+			// 後ろへずらす場合は末尾側から
+			const size_t off = (to > from) ? len - done - step : done;
+			if (!file.seek(from + off) || !file.read(&buf.front(), step) ||
+				!file.seek(to + off) || !file.write(&buf.front(), step)) return false;
+			done += step;
+		}
+		return true;
+	}
+
+	FileMapping map_;
+	Image image_;
+	Tree tree_;
+	std::basic_string<PathChar> path_;
+	Error error_;
+	size_t saved_;
+	bool strip_;
+	bool clean_;
+};
+
+} // namespace PEResource
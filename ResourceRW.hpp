@@ -5,6 +5,9 @@
 #include "tp_stub.h"
 #include "simplebinder.hpp"
 
+#include "PEResource.hpp"
+#include "TextCodec.hpp"
+
 //#define RESOURCERW_NO_ICONRES
 //#define RESOURCERW_NO_WRITER
 //#define RESOURCERW_NO_READER
@@ -24,20 +27,87 @@ class ResourceUtil {
 protected:
 	WORD lang_;
 
-	static bool getResTypeAndName(tTJSVariant *type, tTJSVariant *name, LPCWSTR &lpType, LPCWSTR &lpName) {
-		lpType = lpName = NULL;
-		switch (type->Type()) {
-		case tvtInteger: lpType = MAKEINTRESOURCEW((int)type->AsInteger()); break;
-		case tvtString:  lpType = type->GetString(); break;
-		default: return false;
-		}
-		if (name) switch (name->Type()) {
-		case tvtInteger: lpName = MAKEINTRESOURCEW((int)name->AsInteger()); break;
-		case tvtString:  lpName = name->GetString(); break;
+	static bool getResName(tTJSVariant *var, PEResource::ResName &res) {
+		switch (var->Type()) {
+		case tvtInteger: res = PEResource::ResName((WORD)var->AsInteger()); break;
+		case tvtString: {
+			const tjs_char *str = var->GetString();
+			if (!str) return false;
+			size_t len = 0;
+			while (str[len]) ++len;
+			// FindResource と同様に "#123" は ID 指定として扱う
+			if (len > 1 && str[0] == TJS_W('#')) {
+				DWORD id = 0;
+				size_t n = 1;
+				for (; n < len && str[n] >= TJS_W('0') && str[n] <= TJS_W('9') && id <= 0xFFFF; ++n) id = id * 10 + (str[n] - TJS_W('0'));
+				if (n == len && id <= 0xFFFF) {
+					res = PEResource::ResName((WORD)id);
+					break;
+				}
+			}
+			res = PEResource::ResName(reinterpret_cast<const char16_t*>(str), len);
+		}	break;
 		default: return false;
 		}
 		return true;
 	}
+	static void SetResName(tTJSVariant &var, const PEResource::ResName &res) {
+		if (res.isString()) var = ttstr(reinterpret_cast<const tjs_char*>(res.str), (tjs_int)res.len);
+		else                var = (tTVInteger)res.id;
+	}
+	// octet は不変なので参照を保持すればコピーせずに使える
+	static std::shared_ptr<const void> HoldOctet(tTJSVariantOctet *oct) {
+		oct->AddRef();
+		return std::shared_ptr<const void>(oct, [](const void *p) { ((tTJSVariantOctet*)p)->Release(); });
+	}
+	// 辞書の列挙: func(const ttstr &key, const tTJSVariant &value)
+	template <class F>
+	class DictEnumCaller : public tTJSDispatch {
+		F &func_;
+	public:
+		DictEnumCaller(F &func) : func_(func) {}
+		virtual tjs_error TJS_INTF_METHOD FuncCall(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint, tTJSVariant *result, tjs_int numparams, tTJSVariant **param, iTJSDispatch2 *objthis) {
+			if (numparams > 2 && !(param[1]->AsInteger() & TJS_HIDDENMEMBER)) func_(ttstr(*param[0]), *param[2]);
+			if (result) *result = true;
+			return TJS_S_OK;
+		}
+	};
+	template <class F>
+	static bool EnumDictionary(const tTJSVariant &dict, F &func) {
+		iTJSDispatch2 *obj = (dict.Type() == tvtObject) ? dict.AsObjectNoAddRef() : 0;
+		if (!obj) return false;
+		DictEnumCaller<F> caller(func);
+		tTJSVariantClosure closure(&caller, 0);
+		return TJS_SUCCEEDED(obj->EnumMembers(TJS_IGNOREPROP, &closure, obj));
+	}
+
+#ifndef RESOURCERW_NO_VERSIONRES
+	static void SetQueryResult(tTJSVariant &var, const VersionResource::QueryResult &res) {
+		switch (res.kind) {
+		case VersionResource::QueryResult::TEXT:
+			var = ttstr(reinterpret_cast<const tjs_char*>(res.ptr), (tjs_int)(res.size / sizeof(tjs_char)));
+			break;
+		case VersionResource::QueryResult::TRANSLATION: {
+			// getLangList と同じく (lang<<16)|codepage の配列
+			iTJSDispatch2 *arr = TJSCreateArrayObject();
+			for (size_t n = 0; n + 4 <= res.size; n += 4) {
+				const BYTE *p = res.ptr + n;
+				tTJSVariant v((tTVInteger)(((DWORD)(p[0] | (p[1] << 8)) << 16) | (DWORD)(p[2] | (p[3] << 8))));
+				arr->PropSetByNum(TJS_MEMBERENSURE, (tjs_int)(n / 4), &v, arr);
+			}
+			var = tTJSVariant(arr, arr);
+			arr->Release();
+		}	break;
+		case VersionResource::QueryResult::FIXED:
+		case VersionResource::QueryResult::BINARY:
+			var = tTJSVariant((const tjs_uint8*)res.ptr, (tjs_uint)res.size);
+			break;
+		default:
+			var.Clear();
+			break;
+		}
+	}
+#endif
 
 public:
 	ResourceUtil() : lang_(MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL)) {}
@@ -148,7 +218,7 @@ public:
 			if (voct->Type() != tvtOctet) return TJS_E_INVALIDPARAM;
 			tTJSVariantOctet *oct = voct->AsOctetNoAddRef();
 			if (oct) {
-				image_.load(oct->GetData(), oct->GetLength());
+				image_.load(oct->GetData(), oct->GetLength(), HoldOctet(oct));
 				if (r) *r = (tjs_int)image_.getCount();
 			} else {
 				if (r) *r = 0;
@@ -157,11 +227,15 @@ public:
 		}
 		tjs_error toOctet(tTJSVariant *r) {
 			if (r) {
-				std::vector<tjs_uint8> tmp;
-				image_.save(tmp);
-				const tjs_uint len = tmp.size();
-				if (len > 0) *r = tTJSVariant(&tmp.front(), len);
-				else r->Clear();
+				// 画像を一つの領域に詰めてヘッダと連結したoctetを直接作る
+				const BYTE *img = nullptr;
+				size_t imglen = 0;
+				image_.packImages(img, imglen);
+				std::vector<BYTE> head(image_.headerSize());
+				image_.saveHeader(&head.front());
+				tTJSVariantOctet *oct = TJSAllocVariantOctet(&head.front(), (tjs_uint)head.size(), img, (tjs_uint)imglen);
+				*r = oct;
+				oct->Release();
 			}
 			return TJS_S_OK;
 		}
@@ -195,10 +269,11 @@ public:
 		}
 		tjs_error getImage(tTJSVariant *r, tTJSVariant *vidx) {
 			if (!r) return TJS_S_OK;
-			const ImageData *img = image_.getImage((tjs_int)*vidx);
-			if (img) {
-				if (img->size() > 0) {
-					*r = tTJSVariant((const tjs_uint8*)&img->front(), img->size());
+			const BYTE *img = nullptr;
+			size_t len = 0;
+			if (image_.getImage((tjs_int)*vidx, img, len)) {
+				if (len > 0) {
+					*r = tTJSVariant((const tjs_uint8*)img, (tjs_uint)len);
 				} else {
 					*r = tTJSVariant((const tjs_uint8*)0, 0);
 				}
@@ -245,9 +320,22 @@ public:
 		}
 	public:
 		const IconResource::ImageContainer& getImageContainer() const { return image_; }
+		/**/  IconResource::ImageContainer& getImageContainer()       { return image_; }
 		void buildFromGroup(const IconResource::GroupContainer &grp) {
 			grp.extract(image_);
 		}
+		static tjs_error CreateObject(tTJSVariant *r, IconImage* &icon) {
+			iTJSDispatch2 *clsobj = SimpleBinder::BindUtil::GetObject(TJS_W("ResourceIconImage"));
+			if (!clsobj) return TJS_E_NATIVECLASSCRASH;
+			iTJSDispatch2 *obj = 0;
+			tjs_error err = Try_iTJSDispatch2_CreateNew(clsobj, 0, 0, 0, &obj, 0, 0, clsobj);
+			if (TJS_FAILED(err)) return err;
+			if (!obj) return TJS_E_NATIVECLASSCRASH;
+			*r = tTJSVariant(obj, obj);
+			obj->Release();
+			icon = SimpleBinder::BindUtil::GetInstance(obj, (IconImage*)0);
+			return icon ? TJS_S_OK : TJS_E_NATIVECLASSCRASH;
+		}
 		static bool Entry(bool link) {
 			return (SimpleBinder::BindUtil(link)
 					.Class(TJS_W("ResourceIconImage"), &IconImage::CreateNew)
@@ -296,16 +384,9 @@ public:
 		}
 		tjs_error toIcon(tTJSVariant *r) {
 			if (!r) return TJS_S_OK;
-			iTJSDispatch2 *clsobj = SimpleBinder::BindUtil::GetObject(TJS_W("ResourceIconImage"));
-			if (!clsobj) return TJS_E_NATIVECLASSCRASH;
-			iTJSDispatch2 *obj = 0;
-			tjs_error err = Try_iTJSDispatch2_CreateNew(clsobj, 0, 0, 0, &obj, 0, 0, clsobj);
+			IconImage *icon = 0;
+			tjs_error err = IconImage::CreateObject(r, icon);
 			if (TJS_FAILED(err)) return err;
-			if (!obj) return TJS_E_NATIVECLASSCRASH;
-			*r = tTJSVariant(obj, obj);
-			obj->Release();
-			IconImage *icon = SimpleBinder::BindUtil::GetInstance(obj, (IconImage*)0);
-			if (!icon) return TJS_E_NATIVECLASSCRASH;
 			icon->buildFromGroup(group_);
 			return TJS_S_OK;
 		}
@@ -322,14 +403,27 @@ public:
 		}
 		tjs_error toOctet(tTJSVariant *r) {
 			if (r) {
-				std::vector<tjs_uint8> tmp;
-				group_.save(tmp);
-				const tjs_uint len = tmp.size();
-				if (len > 0) *r = tTJSVariant(&tmp.front(), len);
-				else r->Clear();
+				size_t len = 0;
+				const BYTE *ents = group_.getEntries(len);
+				tTJSVariantOctet *oct = TJSAllocVariantOctet((const tjs_uint8*)&group_.getDir(), sizeof(IconResource::ICONDIR), ents, (tjs_uint)len);
+				*r = oct;
+				oct->Release();
 			}
 			return TJS_S_OK;
 		}
+		/**
+		 * function findBest(width, height, bpp=0);
+		 * @return 最も近い画像の RT_ICON ID（無ければ void）
+		 */
+		tjs_error findBest(tTJSVariant *r, tTJSVariant *vw, tTJSVariant *vh, tjs_int optnum, tTJSVariant **optargs) {
+			if (!r) return TJS_S_OK;
+			const int bpp = optnum > 0 ? (tjs_int)*optargs[0] : 0;
+			const int best = group_.findBest((tjs_int)*vw, (tjs_int)*vh, bpp);
+			int id = -1;
+			if (best >= 0 && group_.getID(best, id)) *r = (tjs_int)id;
+			else r->Clear();
+			return TJS_S_OK;
+		}
 	public:
 		static bool Entry(bool link) {
 			return (SimpleBinder::BindUtil(link)
@@ -338,6 +432,7 @@ public:
 					.Function(TJS_W("toIcon"),    &IconGroup::toIcon)
 					.Function(TJS_W("fromOctet"), &IconGroup::fromOctet)
 					.Function(TJS_W("toOctet"),   &IconGroup::toOctet)
+					.Function(TJS_W("findBest"),  &IconGroup::findBest)
 					.IsValid());
 		}
 	};
@@ -401,6 +496,247 @@ public:
 			if (r) *r = result ? 1 : 0;
 			return TJS_S_OK;
 		}
+		/**
+		 * function changeStrings(dict, langs=void);
+		 * @param dict %[ key:value, ... ]
+		 * @param langs 対象言語（数値か配列，void なら全言語）
+		 * @return 変更したテーブル数
+		 */
+		tjs_error changeStrings(tTJSVariant *r, tTJSVariant *vdict, tjs_int optnum, tTJSVariant **optargs) {
+			struct Collector {
+				VersionResource::VersionContainer &verinfo;
+				std::vector<VersionResource::StringEdit> edits;
+				void operator()(const ttstr &key, const tTJSVariant &value) {
+					const ttstr val(value);
+					const VersionResource::StringEdit edit = {
+						verinfo.intern((const char16_t*)key.c_str(), key.length()),
+						verinfo.intern((const char16_t*)val.c_str(), val.length()) };
+					edits.push_back(edit);
+				}
+			} collector = { verinfo_ };
+			if (!EnumDictionary(*vdict, collector)) return TJS_E_INVALIDPARAM;
+
+			std::vector<DWORD> langs;
+			const bool all = (optnum == 0 || optargs[0]->Type() == tvtVoid);
+			if (!all) GetLangs(*optargs[0], langs);
+			const size_t count = verinfo_.changeStrings(collector.edits, all ? nullptr : &langs);
+			if (r) *r = (tTVInteger)count;
+			return TJS_S_OK;
+		}
+		/**
+		 * function changeInfos(dict, sync=false);
+		 * @param dict %[ key:value, ... ] （changeInfo と同じキー）
+		 * @param sync FileVersion/ProductVersion 文字列を全言語で数値にそろえる
+		 * @return 変更した項目数
+		 */
+		tjs_error changeInfos(tTJSVariant *r, tTJSVariant *vdict, tjs_int optnum, tTJSVariant **optargs) {
+			struct Applier {
+				VersionResource::VersionContainer &verinfo;
+				tjs_int count;
+				void operator()(const ttstr &key, const tTJSVariant &value) {
+					const VersionResource::VsString name((const char16_t*)key.c_str(), key.length());
+					if (verinfo.changeFileInfo(name, (tjs_uint64)value.AsInteger())) ++count;
+				}
+			} applier = { verinfo_, 0 };
+			if (!EnumDictionary(*vdict, applier)) return TJS_E_INVALIDPARAM;
+			if (optnum > 0 && optargs[0]->operator bool()) verinfo_.syncVersionStrings();
+			if (r) *r = applier.count;
+			return TJS_S_OK;
+		}
+		static void GetLangs(const tTJSVariant &var, std::vector<DWORD> &langs) {
+			iTJSDispatch2 *arr = (var.Type() == tvtObject) ? var.AsObjectNoAddRef() : 0;
+			if (!arr) {
+				langs.push_back((DWORD)var.AsInteger());
+				return;
+			}
+			tTJSVariant count;
+			static ttstr s_count(TJS_W("count"));
+			if (TJS_FAILED(arr->PropGet(0, s_count.c_str(), s_count.GetHint(), &count, arr))) return;
+			const tjs_int num = (tjs_int)count.AsInteger();
+			for (tjs_int n = 0; n < num; ++n) {
+				tTJSVariant v;
+				if (TJS_SUCCEEDED(arr->PropGetByNum(0, n, &v, arr))) langs.push_back((DWORD)v.AsInteger());
+			}
+		}
+
+		/**
+		 * function toDictionary();
+		 * @return %[ fixed:%[ FileVersion:..., ... ], strings:%[ "041104b0":%[ key:value, ... ], ... ], translations:[ lang, ... ],
+		 *            vars:%[ Translation:[ lang, ... ], ... ], rawFileInfo:%[ key:octet, ... ] ]
+		 */
+		tjs_error toDictionary(tTJSVariant *r) {
+			if (!r) return TJS_S_OK;
+			iTJSDispatch2 *dict = TJSCreateDictionaryObject();
+			*r = tTJSVariant(dict, dict);
+			dict->Release();
+
+			iTJSDispatch2 *fixed = TJSCreateDictionaryObject();
+			for (const char16_t* const *key = VersionResource::VersionContainer::FileInfoKeys(); *key; ++key) {
+				uint64_t val = 0;
+				if (verinfo_.getFileInfo(*key, val)) SetMember(fixed, ttstr((const tjs_char*)*key), tTJSVariant((tTVInteger)val));
+			}
+			SetMember(dict, TJS_W("fixed"), fixed);
+
+			struct TableDumper {
+				iTJSDispatch2 *strings;
+				void operator()(const VersionResource::StringTable &table) {
+					iTJSDispatch2 *tbl = TJSCreateDictionaryObject();
+					for (auto it = table.Children.cbegin(); it != table.Children.cend(); ++it) {
+						SetMember(tbl, ToString(it->szKey), tTJSVariant(ToString(it->Value)));
+					}
+					SetMember(strings, ToString(table.szKey), tbl);
+				}
+			} dumper = { TJSCreateDictionaryObject() };
+			verinfo_.enumTables(dumper);
+			SetMember(dict, TJS_W("strings"), dumper.strings);
+
+			std::vector<DWORD> list;
+			const size_t count = verinfo_.getTranslations(list);
+			iTJSDispatch2 *arr = TJSCreateArrayObject();
+			for (size_t n = 0; n < count; ++n) {
+				tTJSVariant v((tTVInteger)list[n]);
+				arr->PropSetByNum(TJS_MEMBERENSURE, (tjs_int)n, &v, arr);
+			}
+			SetMember(dict, TJS_W("translations"), arr);
+
+			struct VarDumper {
+				iTJSDispatch2 *vars;
+				void operator()(const VersionResource::Var &var) {
+					iTJSDispatch2 *values = TJSCreateArrayObject();
+					for (size_t n = 0; n < var.Value.size(); ++n) {
+						tTJSVariant v((tTVInteger)var.Value[n]);
+						values->PropSetByNum(TJS_MEMBERENSURE, (tjs_int)n, &v, values);
+					}
+					SetMember(vars, ToString(var.szKey), values);
+				}
+			} vars = { TJSCreateDictionaryObject() };
+			verinfo_.enumVars(vars);
+			SetMember(dict, TJS_W("vars"), vars.vars);
+
+			struct RawDumper {
+				iTJSDispatch2 *infos;
+				void operator()(const VersionResource::VsString &key, const BYTE *ptr, size_t len) {
+					tTJSVariantOctet *oct = TJSAllocVariantOctet((const tjs_uint8*)ptr, (tjs_uint)len);
+					SetMember(infos, ToString(key), tTJSVariant(oct));
+					oct->Release();
+				}
+			} raws = { TJSCreateDictionaryObject() };
+			verinfo_.enumRawFileInfo(raws);
+			SetMember(dict, TJS_W("rawFileInfo"), raws.infos);
+			return TJS_S_OK;
+		}
+		/**
+		 * function fromDictionary(dict);
+		 * toDictionary と同じ形式から作り直す（fixed の無い項目は既定値）
+		 * 別のコンテナに組み立て，全て成功した場合だけ入れ替える
+		 */
+		tjs_error fromDictionary(tTJSVariant *r, tTJSVariant *vdict) {
+			iTJSDispatch2 *dict = (vdict->Type() == tvtObject) ? vdict->AsObjectNoAddRef() : 0;
+			if (!dict) return TJS_E_INVALIDPARAM;
+			VersionResource::VersionContainer work;
+			work.create();
+
+			tTJSVariant fixed, strings, translations, vars, raws;
+			if (GetMember(dict, TJS_W("fixed"), fixed)) {
+				struct Applier {
+					VersionResource::VersionContainer &verinfo;
+					void operator()(const ttstr &key, const tTJSVariant &value) {
+						verinfo.changeFileInfo(VersionResource::VsString((const char16_t*)key.c_str(), key.length()), (tjs_uint64)value.AsInteger());
+					}
+				} applier = { work };
+				EnumDictionary(fixed, applier);
+			}
+			bool ok = true;
+			if (GetMember(dict, TJS_W("strings"), strings)) {
+				struct TableLoader {
+					VersionResource::VersionContainer &verinfo;
+					bool ok;
+					void operator()(const ttstr &key, const tTJSVariant &value) {
+						DWORD lang = 0;
+						if (!VersionResource::StringTable::ParseLang(VersionResource::VsString((const char16_t*)key.c_str(), key.length()), lang) ||
+							!verinfo.addTable(lang)) {
+							ok = false;
+							return;
+						}
+						struct Collector {
+							VersionResource::VersionContainer &verinfo;
+							std::vector<VersionResource::StringEdit> edits;
+							void operator()(const ttstr &key, const tTJSVariant &value) {
+								const ttstr val(value);
+								const VersionResource::StringEdit edit = {
+									verinfo.intern((const char16_t*)key.c_str(), key.length()),
+									verinfo.intern((const char16_t*)val.c_str(), val.length()) };
+								edits.push_back(edit);
+							}
+						} collector = { verinfo };
+						EnumDictionary(value, collector);
+						const std::vector<DWORD> langs(1, lang);
+						verinfo.changeStrings(collector.edits, &langs);
+					}
+				} loader = { work, true };
+				EnumDictionary(strings, loader);
+				ok = loader.ok;
+			}
+			if (ok && GetMember(dict, TJS_W("vars"), vars)) {
+				struct VarLoader {
+					VersionResource::VersionContainer &verinfo;
+					bool ok;
+					void operator()(const ttstr &key, const tTJSVariant &value) {
+						std::vector<DWORD> values;
+						GetLangs(value, values);
+						if (!verinfo.setVar(VersionResource::VsString((const char16_t*)key.c_str(), key.length()), values)) ok = false;
+					}
+				} loader = { work, true };
+				EnumDictionary(vars, loader);
+				ok = loader.ok;
+			}
+			if (ok && GetMember(dict, TJS_W("translations"), translations)) {
+				std::vector<DWORD> langs;
+				GetLangs(translations, langs);
+				for (auto it = langs.cbegin(); it != langs.cend(); ++it) work.addTranslation(*it);
+			}
+			if (ok && GetMember(dict, TJS_W("rawFileInfo"), raws)) {
+				struct RawLoader {
+					VersionResource::VersionContainer &verinfo;
+					bool ok;
+					void operator()(const ttstr &key, const tTJSVariant &value) {
+						tTJSVariantOctet *oct = (value.Type() == tvtOctet) ? value.AsOctetNoAddRef() : 0;
+						if (!oct || !verinfo.addRawFileInfo(oct->GetData(), oct->GetLength())) ok = false;
+					}
+				} loader = { work, true };
+				EnumDictionary(raws, loader);
+				ok = loader.ok;
+			}
+			if (ok) verinfo_.swap(work);
+			if (r) *r = ok ? 1 : 0;
+			return TJS_S_OK;
+		}
+		static ttstr ToString(const VersionResource::VsString &str) {
+			return ttstr((const tjs_char*)str.c_str(), (tjs_int)str.length());
+		}
+		static void SetMember(iTJSDispatch2 *obj, const ttstr &name, const tTJSVariant &value) {
+			obj->PropSet(TJS_MEMBERENSURE, name.c_str(), 0, &value, obj);
+		}
+		static void SetMember(iTJSDispatch2 *obj, const ttstr &name, iTJSDispatch2 *child) {
+			const tTJSVariant value(child, child);
+			child->Release();
+			SetMember(obj, name, value);
+		}
+		static bool GetMember(iTJSDispatch2 *obj, const tjs_char *name, tTJSVariant &value) {
+			return TJS_SUCCEEDED(obj->PropGet(0, name, 0, &value, obj)) && value.Type() != tvtVoid;
+		}
+
+		tjs_error query(tTJSVariant *r, tTJSVariant *vpath) {
+			const ttstr path(*vpath);
+			VersionResource::QueryResult res;
+			std::vector<BYTE> work;
+			const bool found = verinfo_.query((const char16_t*)path.c_str(), res, work);
+			if (r) {
+				if (found) SetQueryResult(*r, res);
+				else r->Clear();
+			}
+			return TJS_S_OK;
+		}
 
 		tjs_error fromOctet(tTJSVariant *r, tTJSVariant *voct) {
 			if (voct->Type() != tvtOctet) return TJS_E_INVALIDPARAM;
@@ -415,10 +751,10 @@ public:
 		}
 		tjs_error toOctet(tTJSVariant *r) {
 			if (r) {
-				std::vector<tjs_uint8> tmp;
-				verinfo_.save(tmp);
-				const tjs_uint len = tmp.size();
-				if (len > 0) *r = tTJSVariant(&tmp.front(), len);
+				std::vector<BYTE> work;
+				size_t len = 0;
+				const BYTE *ptr = verinfo_.image(len, work);
+				if (len > 0) *r = tTJSVariant((const tjs_uint8*)ptr, (tjs_uint)len);
 				else r->Clear();
 			}
 			return TJS_S_OK;
@@ -433,6 +769,11 @@ public:
 					.Function(TJS_W("addLang"),      &VersionInfo::addLang)
 					.Function(TJS_W("removeLang"),   &VersionInfo::removeLang)
 					.Function(TJS_W("copyLang"),     &VersionInfo::copyLang)
+					.Function(TJS_W("changeStrings"), &VersionInfo::changeStrings)
+					.Function(TJS_W("changeInfos"),  &VersionInfo::changeInfos)
+					.Function(TJS_W("query"),        &VersionInfo::query)
+					.Function(TJS_W("toDictionary"), &VersionInfo::toDictionary)
+					.Function(TJS_W("fromDictionary"), &VersionInfo::fromDictionary)
 					.Function(TJS_W("fromOctet"),    &VersionInfo::fromOctet)
 					.Function(TJS_W("toOctet"),      &VersionInfo::toOctet)
 					.IsValid());
@@ -443,30 +784,91 @@ public:
 
 #ifndef RESOURCERW_NO_WRITER
 class ResourceWriter : public ResourceUtil {
-	HANDLE handle_;
-	bool changed_;
+	typedef PEResource::Tree::Payload Payload;
+	PEResource::Writer writer_;
+	ttstr file_;
 public:
-	ResourceWriter() : handle_(NULL), changed_(false) {}
-	ResourceWriter(const ttstr &file, bool clean = false) : handle_(NULL), changed_(false) { open_(file, clean); }
+	ResourceWriter() {}
+	ResourceWriter(const ttstr &file, bool clean = false) { open_(file, clean); }
 	virtual ~ResourceWriter() { close_(false); }
 
 protected:
 	void open_(const ttstr &file, bool clean = false) {
-		if (handle_) close_(false);
+		if (writer_.isOpen()) close_(false);
 		ttstr local(file);
 		TVPGetLocalName(local);
-		handle_ = ::BeginUpdateResourceW(local.c_str(), clean ? TRUE : FALSE);
-		if (!handle_) ThrowLastError(TJS_W("BeginUpdateResource: %1"));
-		changed_ = clean;
+		if (!writer_.open(local.c_str(), clean)) {
+			if (writer_.lastError() == PEResource::Writer::ERR_OPEN) ThrowLastError(TJS_W("CreateFileMapping: %1"));
+			TVPThrowExceptionMessage(TJS_W("invalid PE image: %1"), file);
+		}
+		file_ = file;
 	}
 
-	void close_(bool write = true) {
-		if (!handle_) return;
-		if (!::EndUpdateResourceW(handle_, (write && changed_) ? FALSE : TRUE)) {
-			handle_ = NULL;
-			ThrowLastError(TJS_W("EndUpdateResource: %1"));
+	// 書き出した場合は同じ内容のデータを共有して減らしたバイト数を返す
+	tTVInteger close_(bool write = true) {
+		if (!writer_.isOpen()) return 0;
+		tTVInteger saved = 0;
+		// 変更が無ければ書き出さない
+		if (write && writer_.tree().pendingCount() > 0) {
+			const bool ok = writer_.commit();
+			saved = (tTVInteger)writer_.savedBytes();
+			if (!ok) {
+				writer_.close();
+				if (writer_.lastError() == PEResource::Writer::ERR_LAYOUT) TVPThrowExceptionMessage(TJS_W("cannot relocate resource section: %1"), file_);
+				TVPThrowExceptionMessage(TJS_W("write failed: %1"), file_);
+			}
+		}
+		writer_.close();
+		return saved;
+	}
+
+	// 書き出し時に読み込むファイル
+	class FileSource : public PEResource::Source {
+	public:
+		FileSource(const ttstr &file) : file_(file), stream_(0), size_(0) {
+			if (!open()) TVPThrowExceptionMessage(TJS_W("cannot open file: %1"), file_);
+			STATSTG stat;
+			stream_->Stat(&stat, STATFLAG_NONAME);
+			const tjs_uint64 qsize = (tjs_uint64)stat.cbSize.QuadPart;
+			close();
+			if (qsize > 0xFFFFFFFF) TVPThrowExceptionMessage(TJS_W("too large file: %1"), file_);
+			size_ = (DWORD)qsize;
+		}
+		~FileSource() { close(); }
+		DWORD size() const { return size_; }
+
+		bool open() {
+			close();
+			stream_ = TVPCreateIStream(file_, TJS_BS_READ);
+			return stream_ != 0;
+		}
+		size_t read(BYTE *buf, size_t len) {
+			DWORD got = 0;
+			if (!stream_ || FAILED(stream_->Read(buf, (DWORD)len, &got))) return 0;
+			return got;
+		}
+		void close() {
+			if (stream_) stream_->Release();
+			stream_ = 0;
 		}
-		handle_ = NULL;
+	private:
+		ttstr file_;
+		IStream *stream_;
+		DWORD size_;
+	};
+
+	void getResKeys(tTJSVariant *type, tTJSVariant *name, PEResource::ResName &resType, PEResource::ResName &resName) {
+		if (!getResName(type, resType) || !getResName(name, resName)) TVPThrowExceptionMessage(TJS_W("invalid name or type."));
+	}
+	void update_(tTJSVariant *type, tTJSVariant *name, Payload &data) {
+		PEResource::ResName resType, resName;
+		getResKeys(type, name, resType, resName);
+		writer_.tree().set(resType, resName, lang_, data);
+	}
+	void update_(tTJSVariant *type, tTJSVariant *name, const BYTE *ptr, DWORD size, const PEResource::Tree::Holder &hold) {
+		PEResource::ResName resType, resName;
+		getResKeys(type, name, resType, resName);
+		writer_.tree().set(resType, resName, lang_, ptr, size, hold);
 	}
 
 
@@ -492,16 +894,17 @@ public:
 	 */
 	tjs_error open(tTJSVariant *r, tTJSVariant *filename, tjs_int optnum, tTJSVariant **optargs) {
 		open_(*filename, optnum>0 && optargs[0]->operator bool());
-		if (r) *r = (tTVInteger)(tjs_intptr_t)handle_;
+		if (r) *r = writer_.isOpen() ? 1 : 0;
 		return TJS_S_OK;
 	}
 	/**
 	 * function close(write = true);
 	 * @param optional write 結果を書き出すかどうか
+	 * @return 同じ内容のデータを共有して減らしたバイト数
 	 */
 	tjs_error close(tTJSVariant *r, tjs_int optnum, tTJSVariant **optargs) {
-		close_(optnum==0 || optargs[0]->operator bool());
-		if (r) r->Clear();
+		const tTVInteger saved = close_(optnum==0 || optargs[0]->operator bool());
+		if (r) *r = saved;
 		return TJS_S_OK;
 	}
 
@@ -511,16 +914,12 @@ public:
 	 * @param name リソース名(int, string)
 	 */
 	tjs_error clear(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name) {
-		if (!handle_) return TJS_E_FAIL;
+		if (!writer_.isOpen()) return TJS_E_FAIL;
 
-		LPCWSTR lpType, lpName;
-		if (!getResTypeAndName(type, name, lpType, lpName)) return TJS_E_INVALIDPARAM;
+		PEResource::ResName resType, resName;
+		if (!getResName(type, resType) || !getResName(name, resName)) return TJS_E_INVALIDPARAM;
 
-		if (::UpdateResourceW(handle_, lpType, lpName, lang_, NULL, 0) == FALSE) {
-			ThrowLastError(TJS_W("UpdateResource: %1"));
-		} else {
-			changed_ = true;
-		}
+		writer_.tree().remove(resType, resName, lang_);
 		if (r) r->Clear();
 		return TJS_S_OK;
 	}
@@ -532,42 +931,26 @@ public:
 	 * @param text リソース内容(string)
 	 */
 	tjs_error writeFromText(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name, tTJSVariant *text, tjs_int optnum, tTJSVariant **optargs) {
-		if (!handle_) return TJS_E_FAIL;
+		if (!writer_.isOpen()) return TJS_E_FAIL;
 
-		LPCWSTR lpType, lpName;
-		if (!getResTypeAndName(type, name, lpType, lpName)) return TJS_E_INVALIDPARAM;
-
-		LPVOID lpData = 0;
-		DWORD  cbData = 0;
-		ttstr tmp(*text);
+		Payload data;
+		const ttstr src(*text);
 		bool utf8 = optnum>0 && optargs[0]->operator bool();
 		if (utf8) {
-			const ttstr src(tmp);
-			const tjs_char *error = 0;
-			int maxlen = TVPWideCharToUtf8String(src.c_str(), NULL);
-			if (maxlen < 0) error = TJS_W("invalid character in %1");
-			else {
-				char *out = (char*)tmp.AllocBuffer(maxlen + 1);
-				cbData = TVPWideCharToUtf8String(src.c_str(), out);
-				if (cbData != (DWORD)maxlen) error = TJS_W("mismatch length %1");
-				out[maxlen] = 0;
-				lpData = (LPVOID)out;
-			}
-			if (error) {
+			// 1文字最大3バイトで確保して1パスで変換
+			size_t len = 0;
+			data.resize(src.length() * 3);
+			if (src.length() > 0 && !TextCodec::Utf16ToUtf8(src.c_str(), src.length(), &data.front(), len)) {
 				tTJSVariant strname(*name);
 				strname.ToString();
-				TVPThrowExceptionMessage(error, strname.GetString());
+				TVPThrowExceptionMessage(TJS_W("invalid character in %1"), strname.GetString());
 			}
+			data.resize(len); // 終端は含めない
 		} else {
-			lpData = (void*)tmp.c_str();
-			cbData = (tmp.length()+1) * sizeof(tjs_char);
-		}
-		if (::UpdateResourceW(handle_, lpType, lpName, lang_, lpData, cbData) == FALSE) {
-			ThrowLastError(TJS_W("UpdateResource: %1"));
-		} else {
-			changed_ = true;
+			const BYTE *ptr = (const BYTE*)src.c_str();
+			data.assign(ptr, ptr + (src.length()+1) * sizeof(tjs_char));
 		}
-		tmp.Clear();
+		update_(type, name, data);
 		if (r) r->Clear();
 		return TJS_S_OK;
 	}
@@ -579,20 +962,12 @@ public:
 	 * @param oct  リソース内容(octet)
 	 */
 	tjs_error writeFromOctet(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name, tTJSVariant *oct) {
-		if (!handle_) return TJS_E_FAIL;
-
-		LPCWSTR lpType, lpName;
-		if (!getResTypeAndName(type, name, lpType, lpName)) return TJS_E_INVALIDPARAM;
+		if (!writer_.isOpen()) return TJS_E_FAIL;
 
 		tTJSVariantOctet *octet = oct->AsOctetNoAddRef();
 		if (octet) {
-			LPVOID lpData = const_cast<tjs_uint8*>(octet->GetData());
-			DWORD  cbData = octet->GetLength();
-			if (::UpdateResourceW(handle_, lpType, lpName, lang_, lpData, cbData) == FALSE) {
-				ThrowLastError(TJS_W("UpdateResource: %1"));
-			} else {
-				changed_ = true;
-			}
+			// octet を参照したまま保持する
+			update_(type, name, octet->GetData(), octet->GetLength(), HoldOctet(octet));
 		}
 		if (r) r->Clear();
 		return TJS_S_OK;
@@ -605,44 +980,195 @@ public:
 	 * @param file リソース内容ファイル(string)
 	 */
 	tjs_error writeFromFile(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name, tTJSVariant *file) {
-		if (!handle_) return TJS_E_FAIL;
-
-		LPCWSTR lpType, lpName;
-		if (!getResTypeAndName(type, name, lpType, lpName)) return TJS_E_INVALIDPARAM;
-
-		IStream *stream = TVPCreateIStream(*file, TJS_BS_READ);
-		if (stream) {
-			try {
-				STATSTG stat;
-				stream->Stat(&stat, STATFLAG_NONAME);
-				tjs_uint64 qsize = (tjs_uint64)stat.cbSize.QuadPart;
-				if (qsize > 0xFFFFFFFF) {
-					TVPThrowExceptionMessage(TJS_W("too large file: %1"), *file);
-				}
-				DWORD size = (DWORD)qsize;
-				BYTE *p = new BYTE[size];
-				try {
-					DWORD read;
-					stream->Read(p, size, &read);
-					if (::UpdateResourceW(handle_, lpType, lpName, lang_, (LPVOID)p, size) == FALSE) {
-						ThrowLastError(TJS_W("UpdateResource: %1"));
-					} else {
-						changed_ = true;
+		if (!writer_.isOpen()) return TJS_E_FAIL;
+
+		// 内容は commit 時にチャンク単位で読み込む
+		std::shared_ptr<FileSource> source = std::make_shared<FileSource>(*file);
+		const DWORD size = source->size();
+		PEResource::ResName resType, resName;
+		getResKeys(type, name, resType, resName);
+		writer_.tree().set(resType, resName, lang_, source, size);
+		if (r) r->Clear();
+		return TJS_S_OK;
+	}
+
+#ifndef RESOURCERW_NO_ICONRES
+	// 書き出し時に読み込むデータを先に読む（小さなもの用）
+	static bool ReadSource(PEResource::Source &src, size_t size, Payload &out) {
+		if (size == 0 || size > 0x100000 || !src.open()) return false;
+		out.resize(size);
+		size_t done = 0;
+		try {
+			while (done < size) {
+				const size_t got = src.read(&out[done], size - done);
+				if (got == 0) break;
+				done += got;
+			}
+		} catch (...) {
+			src.close();
+			throw;
+		}
+		src.close();
+		return done == size;
+	}
+
+	/**
+	 * function writeIcon(name, icon);
+	 * @param name RT_GROUP_ICON のリソース名(int, string)
+	 * @param icon アイコン(ResourceIconImage または .ico の octet)
+	 * @return 各画像に割り当てた RT_ICON の ID 配列
+	 */
+	tjs_error writeIcon(tTJSVariant *r, tTJSVariant *name, tTJSVariant *icon) {
+		if (!writer_.isOpen()) return TJS_E_FAIL;
+
+		IconResource::ImageContainer image;
+		if (icon->Type() == tvtOctet) {
+			tTJSVariantOctet *oct = icon->AsOctetNoAddRef();
+			if (!oct || !image.load(oct->GetData(), oct->GetLength())) return TJS_E_INVALIDPARAM;
+		} else if (icon->Type() == tvtObject) {
+			IconImage *obj = SimpleBinder::BindUtil::GetInstance(icon->AsObjectNoAddRef(), (IconImage*)0);
+			if (!obj) return TJS_E_INVALIDPARAM;
+			image = obj->getImageContainer(); // 画像は共有されるのでコピーは軽い
+		} else return TJS_E_INVALIDPARAM;
+		if (image.isCursor()) TVPThrowExceptionMessage(TJS_W("cursor image is not supported."));
+
+		PEResource::ResName resName;
+		if (!getResName(name, resName)) TVPThrowExceptionMessage(TJS_W("invalid name or type."));
+		const PEResource::ResName grpType((WORD)(tjs_intptr_t)RT_GROUP_ICON), iconType((WORD)(tjs_intptr_t)RT_ICON);
+		PEResource::Tree &tree = writer_.tree();
+
+		// 置き換えるグループの画像ID と，他のグループが参照している画像ID
+		std::vector<int> oldIDs;
+		std::vector<bool> used(0x10000, false), shared(0x10000, false);
+		bool unknown = false; // 解析できないグループがある（どのIDを参照しているか分からない）
+		used[0] = true;
+		if (const PEResource::Tree::Type *t = tree.lookup(grpType)) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				const bool samename = PEResource::ResName::Compare(n->name.ref(), resName) == 0;
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) {
+					IconResource::GroupContainer grp;
+					Payload work;
+					const BYTE *ptr = l->ptr;
+					if (!ptr && l->source && ReadSource(*l->source, l->size, work)) ptr = &work.front(); // writeFromFile のものは読んでみる
+					if (!ptr || !grp.load(ptr, l->size)) {
+						unknown = true;
+						continue;
+					}
+					const bool self = samename && l->lang == lang_;
+					for (size_t i = 0; i < grp.getCount(); ++i) {
+						int id = 0;
+						grp.getID(i, id);
+						if (self) oldIDs.push_back(id);
+						else shared[id & 0xFFFF] = true;
 					}
-				} catch (...) {
-					delete[] p;
-					throw;
 				}
-				delete[] p;
-			} catch (...) {
-				stream->Release();
-				throw;
 			}
-			stream->Release();
 		}
+		if (const PEResource::Tree::Type *t = tree.lookup(iconType)) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				if (!n->name.named) used[n->name.id] = true;
+			}
+		}
+		// 他から参照されていない旧IDを先に再利用し，足りなければ空いているIDを割り当てる
+		//   解析できないグループがあれば旧IDは再利用も削除もしない
+		std::vector<int> freed;
+		for (auto it = oldIDs.cbegin(); it != oldIDs.cend(); ++it) {
+			if (!unknown && !shared[*it] && std::find(freed.begin(), freed.end(), *it) == freed.end()) freed.push_back(*it);
+			used[*it] = true;
+		}
+		// 旧IDの画像が実際にある言語（読み込み時は他の言語の画像もグループの画像として使われる）
+		std::vector<std::pair<int, WORD> > stale;
+		if (const PEResource::Tree::Type *t = freed.empty() ? nullptr : tree.lookup(iconType)) {
+			for (auto n = t->names.cbegin(); n != t->names.cend(); ++n) {
+				if (n->name.named || std::find(freed.begin(), freed.end(), (int)n->name.id) == freed.end()) continue;
+				for (auto l = n->langs.cbegin(); l != n->langs.cend(); ++l) stale.push_back(std::make_pair((int)n->name.id, l->lang));
+			}
+		}
+		// ツリーを変更する前に全てのIDを決める
+		const size_t count = image.getCount();
+		std::vector<int> ids(count);
+		size_t reuse = 0;
+		int next = 1;
+		for (size_t n = 0; n < count; ++n) {
+			if (reuse < freed.size()) {
+				ids[n] = freed[reuse++];
+			} else {
+				while (next < 0x10000 && used[next]) ++next;
+				if (next >= 0x10000) TVPThrowExceptionMessage(TJS_W("no free icon ID."));
+				ids[n] = next;
+				used[next] = true;
+			}
+		}
+
+		iTJSDispatch2 *arr = r ? TJSCreateArrayObject() : 0;
+		for (size_t n = 0; n < count; ++n) {
+			image.setID(n, ids[n]);
+
+			// 画像は元の領域を参照したまま登録する
+			const BYTE *ptr = nullptr;
+			size_t len = 0;
+			PEResource::Tree::Holder hold;
+			image.getImage(n, ptr, len, &hold);
+			tree.set(iconType, PEResource::ResName((WORD)ids[n]), lang_, ptr, (DWORD)len, hold);
+			if (arr) {
+				tTJSVariant v((tjs_int)ids[n]);
+				arr->PropSetByNum(TJS_MEMBERENSURE, (tjs_int)n, &v, arr);
+			}
+		}
+		// 旧画像を削除（再利用したIDの lang_ のものは上書き済み）
+		for (auto it = stale.cbegin(); it != stale.cend(); ++it) {
+			if (it->second == lang_ && std::find(ids.begin(), ids.end(), it->first) != ids.end()) continue;
+			tree.remove(iconType, PEResource::ResName((WORD)it->first), it->second);
+		}
+
+		IconResource::GroupContainer grp;
+		grp.build(image);
+		Payload data;
+		grp.save(data);
+		tree.set(grpType, resName, lang_, data);
+
+		if (arr) {
+			*r = tTJSVariant(arr, arr);
+			arr->Release();
+		}
+		return TJS_S_OK;
+	}
+#endif
+
+	/**
+	 * function rollback();
+	 * open 後の変更を全て取り消す
+	 */
+	tjs_error rollback(tTJSVariant *r) {
+		if (!writer_.isOpen()) return TJS_E_FAIL;
+		writer_.rollback();
 		if (r) r->Clear();
 		return TJS_S_OK;
 	}
+	/**
+	 * property pendingCount, pendingBytes
+	 * 書き出し待ちの変更数（同じ対象への変更は1件）とデータサイズ
+	 */
+	tjs_error getPendingCount(tTJSVariant *r) const {
+		if (r) *r = (tTVInteger)(writer_.isOpen() ? writer_.tree().pendingCount() : 0);
+		return TJS_S_OK;
+	}
+	tjs_error getPendingBytes(tTJSVariant *r) const {
+		if (r) *r = (tTVInteger)(writer_.isOpen() ? writer_.tree().pendingBytes() : 0);
+		return TJS_S_OK;
+	}
+	/**
+	 * property stripSignature
+	 * 書き出し時に証明書テーブル（Authenticode 署名）を取り除くかどうか
+	 */
+	tjs_error getStripSignature(tTJSVariant *r) const {
+		if (r) *r = writer_.getStripSignature() ? 1 : 0;
+		return TJS_S_OK;
+	}
+	tjs_error setStripSignature(const tTJSVariant *v) {
+		writer_.setStripSignature(v->operator bool());
+		return TJS_S_OK;
+	}
 
 	/**
 	 * function setLang(primlang, sublang);
@@ -663,6 +1189,13 @@ public:
 				.Function(TJS_W("writeFromText"), &ResourceWriter::writeFromText)
 				.Function(TJS_W("writeFromFile"), &ResourceWriter::writeFromFile)
 				.Function(TJS_W("writeFromOctet"), &ResourceWriter::writeFromOctet)
+#ifndef RESOURCERW_NO_ICONRES
+				.Function(TJS_W("writeIcon"), &ResourceWriter::writeIcon)
+#endif
+				.Function(TJS_W("rollback"), &ResourceWriter::rollback)
+				.Property(TJS_W("pendingCount"), &ResourceWriter::getPendingCount, 0)
+				.Property(TJS_W("pendingBytes"), &ResourceWriter::getPendingBytes, 0)
+				.Property(TJS_W("stripSignature"), &ResourceWriter::getStripSignature, &ResourceWriter::setStripSignature)
 				.IsValid());
 	}
 };
@@ -670,87 +1203,201 @@ public:
 
 #ifndef RESOURCERW_NO_READER
 class ResourceReader : public ResourceUtil {
-	HMODULE handle_;
+	typedef std::shared_ptr<PEResource::FileMapping> MappingRef;
+	MappingRef map_;  // DataView からも参照されるので共有
+	PEResource::Index index_;
 public:
-	ResourceReader() : handle_(NULL) {}
-	ResourceReader(const ttstr &file) : handle_(NULL) { open_(file); }
+	ResourceReader() {}
+	ResourceReader(const ttstr &file) { open_(file); }
 	virtual ~ResourceReader() { close_(); }
 
 protected:
 	void open_(const ttstr &file) {
-		if (handle_) close_();
+		if (map_) close_();
 		ttstr local(file);
 		TVPGetLocalName(local);
-		handle_ = ::LoadLibraryExW(local.c_str(), NULL, LOAD_LIBRARY_AS_DATAFILE);
-		if (!handle_) ThrowLastError(TJS_W("LoadLibraryEx: %1"));
+		MappingRef map = std::make_shared<PEResource::FileMapping>();
+		if (!map->open(local.c_str())) ThrowLastError(TJS_W("CreateFileMapping: %1"));
+		map_ = map;
+		PEResource::Image image;
+		if (!image.load(map_->data(), map_->size()) || !index_.build(image)) {
+			close_();
+			TVPThrowExceptionMessage(TJS_W("invalid PE image: %1"), file);
+		}
 	}
 
 	void close_() {
-		if (!handle_) return;
-		if (!::FreeLibrary(handle_)) {
-			handle_ = NULL;
-			ThrowLastError(TJS_W("FreeLibrary: %1"));
-		}
-		handle_ = NULL;
+		index_.clear();
+		map_.reset(); // DataView が残っていればマッピングはそちらが解放する
 	}
 
-	HRSRC findResource_(tTJSVariant *type, tTJSVariant *name, DWORD *size = NULL, bool raiseerr = false) {
-		if (!handle_) {
+	bool findResource_(tTJSVariant *type, tTJSVariant *name, PEResource::ResData &data, bool raiseerr = false) {
+		if (!map_) {
 			if (raiseerr) TVPThrowExceptionMessage(TJS_W("target not opened."));
-			return NULL;
+			return false;
 		}
 
-		LPCWSTR lpType, lpName;
-		if (!getResTypeAndName(type, name, lpType, lpName)) {
+		PEResource::ResName resType, resName;
+		if (!getResName(type, resType) || !getResName(name, resName)) {
 			if (raiseerr) TVPThrowExceptionMessage(TJS_W("invalid name or type."));
-			return NULL;
+			return false;
 		}
 
-		HRSRC res = ::FindResourceExW(handle_, lpType, lpName, lang_);
-		if (!res && raiseerr) ThrowLastError(TJS_W("FindResourceEx: %1"));
-		if (res && size) {
-			*size = ::SizeofResource(handle_, res);
+		const bool found = index_.find(resType, resName, lang_, data);
+		if (!found && raiseerr) {
+			tTJSVariant strname(*name);
+			strname.ToString();
+			TVPThrowExceptionMessage(TJS_W("resource not found: %1"), strname.GetString());
 		}
-		return res;
+		return found;
 	}
-	LPVOID loadResource_(tTJSVariant *type, tTJSVariant *name, DWORD *size = NULL) {
-		HRSRC res = findResource_(type, name, size, true);
-		if (res) {
-			HGLOBAL global = ::LoadResource(handle_, res);
-			if (global) {
-				LPVOID ptr = ::LockResource(global);
-				if (ptr) return ptr;
-				ThrowLastError(TJS_W("LockResource: %1"));
-			} else {
-				ThrowLastError(TJS_W("LoadResource: %1"));
-			}
-		}
-		return NULL;
+	const BYTE* loadResource_(tTJSVariant *type, tTJSVariant *name, DWORD *size = NULL) {
+		PEResource::ResData data;
+		if (!findResource_(type, name, data, true)) return NULL;
+		if (size) *size = data.size;
+		return data.ptr;
 	}
 
-	static BOOL CALLBACK EnumTypesProc(HMODULE hModule, LPWSTR lpszType, LONG_PTR lParam) {
-		if (IS_INTRESOURCE(lpszType)) AddEnumResult(lParam, (tTVInteger)lpszType);
-		else                          AddEnumResult(lParam,             lpszType);
-		return TRUE;
+	static iTJSDispatch2* CreateArray(tjs_int count) {
+		iTJSDispatch2 *arr = TJSCreateArrayObject();
+		if (count > 0) {
+			// 先に要素数を確保しておく
+			static ttstr s_count(TJS_W("count"));
+			tTJSVariant v(count);
+			arr->PropSet(TJS_MEMBERENSURE, s_count.c_str(), s_count.GetHint(), &v, arr);
+		}
+		return arr;
 	}
-	static BOOL CALLBACK EnumNamesProc(HMODULE hModule, LPCWSTR lpszType, LPWSTR lpszName, LONG_PTR lParam) {
-		if (IS_INTRESOURCE(lpszName)) AddEnumResult(lParam, (tTVInteger)lpszName);
-		else                          AddEnumResult(lParam,             lpszName);
-		return TRUE;
+	static void SetArrayItem(iTJSDispatch2 *arr, tjs_int n, iTJSDispatch2 *item) {
+		tTJSVariant v(item, item);
+		item->Release();
+		arr->PropSetByNum(TJS_MEMBERENSURE, n, &v, arr);
 	}
-	static BOOL CALLBACK EnumLangsProc(HMODULE hModule, LPCWSTR lpszType, LPCWSTR lpszName, WORD wIDLanguage, LONG_PTR lParam) {
-		AddEnumResult(lParam, (tTVInteger)wIDLanguage);
-		return TRUE;
+
+	// 複数の領域を順に書き出す
+	struct WriteChunk { const BYTE *ptr; DWORD size; };
+	static bool WriteToFile(const BYTE *ptr, DWORD size, const ttstr &file) {
+		const WriteChunk chunk = { ptr, size };
+		return WriteToFile(&chunk, 1, file);
 	}
-	static void AddEnumResult(LONG_PTR lParam, tTJSVariant v) {
-		iTJSDispatch2 *arr = reinterpret_cast<iTJSDispatch2*>(lParam);
-		if (arr) {
-			static ttstr s_add(TJS_W("add"));
-			tTJSVariant *param[] = { &v };
-			Try_iTJSDispatch2_FuncCall(arr, 0, s_add.c_str(), s_add.GetHint(), NULL, 1, param, arr);
+	static bool WriteToFile(const WriteChunk *chunks, size_t count, const ttstr &file) {
+		IStream *stream = TVPCreateIStream(file, TJS_BS_WRITE);
+		if (!stream) return false;
+		try {
+			for (size_t n = 0; n < count; ++n) WriteStream(stream, chunks[n].ptr, chunks[n].size, file);
+		} catch (...) {
+			stream->Release();
+			throw;
+		}
+		stream->Release();
+		return true;
+	}
+	static void WriteStream(IStream *stream, const BYTE *ptr, DWORD size, const ttstr &file) {
+		// 大きなデータも固定長チャンクで書き出す
+		const DWORD chunk = PEResource::ChunkPump::CHUNK;
+		DWORD done = 0;
+		while (done < size) {
+			const DWORD step = (size - done < chunk) ? size - done : chunk;
+			DWORD out = 0;
+			if (stream->Write(ptr + done, step, &out) != S_OK) {
+				TVPThrowExceptionMessage(TJS_W("output error: %1"), file);
+			}
+			if (out == 0) break;
+			done += out;
+		}
+		if (done != size) {
+			TVPThrowExceptionMessage(TJS_W("write failed: %1"), file);
 		}
 	}
 
+	////////////////////////////////////////////////////////////////
+	// マッピング上のリソースデータを参照するビュー
+	class DataView {
+		std::shared_ptr<const PEResource::FileMapping> map_;
+		const BYTE *ptr_;
+		DWORD size_;
+
+		static tjs_error CreateNew(DataView* &inst, tjs_int optnum, tTJSVariant **optargs) {
+			inst = new DataView();
+			return TJS_S_OK;
+		}
+		bool getRange(tjs_int optnum, tTJSVariant **optargs, DWORD &offset, DWORD &length) const {
+			tTVInteger ofs = (optnum > 0 && optargs[0]->Type() != tvtVoid) ? optargs[0]->AsInteger() : 0;
+			tTVInteger len = (optnum > 1 && optargs[1]->Type() != tvtVoid) ? optargs[1]->AsInteger() : (tTVInteger)size_ - ofs;
+			if (ofs < 0 || len < 0 || ofs + len > (tTVInteger)size_) return false;
+			offset = (DWORD)ofs;
+			length = (DWORD)len;
+			return true;
+		}
+
+		/**
+		 * function toOctet(offset=0, length=size-offset);
+		 * 指定範囲だけをoctetにコピーする
+		 */
+		tjs_error toOctet(tTJSVariant *r, tjs_int optnum, tTJSVariant **optargs) {
+			DWORD offset = 0, length = 0;
+			if (!getRange(optnum, optargs, offset, length)) return TJS_E_INVALIDPARAM;
+			if (r) {
+				tTJSVariantOctet *oct = TJSAllocVariantOctet(ptr_ + offset, (tjs_uint)length);
+				*r = oct;
+				oct->Release();
+			}
+			return TJS_S_OK;
+		}
+		/**
+		 * function saveToFile(file);
+		 */
+		tjs_error saveToFile(tTJSVariant *r, tTJSVariant *file) {
+			const bool result = ptr_ && WriteToFile(ptr_, size_, *file);
+			if (r) *r = result ? (tTVInteger)size_ : 0;
+			return TJS_S_OK;
+		}
+		tjs_error getSize(tTJSVariant *r) const {
+			if (r) *r = (tTVInteger)size_;
+			return TJS_S_OK;
+		}
+	public:
+		DataView() : ptr_(0), size_(0) {}
+
+		void assign(const std::shared_ptr<const PEResource::FileMapping> &map, const BYTE *ptr, DWORD size) {
+			map_ = map;
+			ptr_ = ptr;
+			size_ = size;
+		}
+
+		static tjs_error CreateObject(tTJSVariant *r, DataView* &view) {
+			iTJSDispatch2 *clsobj = SimpleBinder::BindUtil::GetObject(TJS_W("ResourceDataView"));
+			if (!clsobj) return TJS_E_NATIVECLASSCRASH;
+			iTJSDispatch2 *obj = 0;
+			tjs_error err = Try_iTJSDispatch2_CreateNew(clsobj, 0, 0, 0, &obj, 0, 0, clsobj);
+			if (TJS_FAILED(err)) return err;
+			if (!obj) return TJS_E_NATIVECLASSCRASH;
+			*r = tTJSVariant(obj, obj);
+			obj->Release();
+			view = SimpleBinder::BindUtil::GetInstance(obj, (DataView*)0);
+			return view ? TJS_S_OK : TJS_E_NATIVECLASSCRASH;
+		}
+		static bool Entry(bool link) {
+			return (SimpleBinder::BindUtil(link)
+					.Class(TJS_W("ResourceDataView"), &DataView::CreateNew)
+					.Function(TJS_W("toOctet"),    &DataView::toOctet)
+					.Function(TJS_W("saveToFile"), &DataView::saveToFile)
+					.Property(TJS_W("size"),       &DataView::getSize, 0)
+					.IsValid());
+		}
+	};
+
+	struct EnumResult {
+		iTJSDispatch2 *arr;
+		tjs_int count;
+		bool operator()(const PEResource::ResName &res) {
+			tTJSVariant v;
+			SetResName(v, res);
+			arr->PropSetByNum(TJS_MEMBERENSURE, count++, &v, arr);
+			return true;
+		}
+	};
+
 public:
 	/**
 	 * function ResorceReader(file) { if (file !== void) open(file); }
@@ -771,7 +1418,7 @@ public:
 	 */
 	tjs_error open(tTJSVariant *r, tTJSVariant *filename) {
 		open_(*filename);
-		if (r) *r = (tTVInteger)(tjs_intptr_t)handle_;
+		if (r) *r = (tTVInteger)(tjs_intptr_t)map_->data();
 		return TJS_S_OK;
 	}
 	/**
@@ -787,8 +1434,9 @@ public:
 	 * function isExistentResource(type, name);
 	 */
 	tjs_error isExistentResource(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name) {
-		HRSRC res = findResource_(type, name);
-		if (r) *r = (res != NULL);
+		PEResource::ResData data;
+		const bool res = findResource_(type, name, data);
+		if (r) *r = res;
 		return TJS_S_OK;
 	}
 	
@@ -798,27 +1446,21 @@ public:
 	 */
 	tjs_error readToText(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name, tjs_int optnum, tTJSVariant **optargs) {
 		DWORD size = 0;
-		LPVOID ptr = loadResource_(type, name, &size);
+		const BYTE *ptr = loadResource_(type, name, &size);
 		if (r) r->Clear();
 		if (ptr) {
 			bool utf8 = optnum>0 && optargs[0]->operator bool();
 			if (utf8) {
+				// UTF-16 の長さはバイト数を超えないので直接バッファに変換
 				ttstr tmp;
-				char *data = 0;
-				tjs_int len = 0;
-				try {
-					data = new char[size+1];
-					memcpy(data, ptr, size);
-					data[size] = 0; // terminator
-					len = TVPUtf8ToWideCharString(data, NULL);
-					tjs_char *out = tmp.AllocBuffer((len+1) * sizeof(tjs_char)); // [XXX]
-					TVPUtf8ToWideCharString(data, out);
-					out[len] = 0;
-				} catch (...) {
-					delete [] data;
-					throw;
+				tjs_char *out = tmp.AllocBuffer(size + 1);
+				size_t len = 0;
+				if (!TextCodec::Utf8ToUtf16(ptr, size, out, len)) {
+					tTJSVariant strname(*name);
+					strname.ToString();
+					TVPThrowExceptionMessage(TJS_W("invalid UTF-8 sequence in %1"), strname.GetString());
 				}
-				delete [] data;
+				out[len] = 0;
 				tmp.FixLen();
 				if (r) *r = tmp;
 			} else {
@@ -834,7 +1476,7 @@ public:
 	 */
 	tjs_error readToOctet(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name) {
 		DWORD size = 0;
-		LPVOID ptr = loadResource_(type, name, &size);
+		const BYTE *ptr = loadResource_(type, name, &size);
 		if (r) r->Clear();
 		if (ptr) {
 			tTJSVariantOctet *oct = TJSAllocVariantOctet((const tjs_uint8*)ptr, (tjs_uint)size);
@@ -849,29 +1491,178 @@ public:
 	 */
 	tjs_error readToFile(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name, tTJSVariant *file) {
 		DWORD size = 0;
-		LPVOID ptr = loadResource_(type, name, &size);
+		const BYTE *ptr = loadResource_(type, name, &size);
 		if (r) r->Clear();
+		if (ptr && WriteToFile(ptr, size, *file)) {
+			if (r) *r = (tTVInteger)size;
+		}
+		return TJS_S_OK;
+	}
+
+	/**
+	 * function readToView(type, name);
+	 * @return ResourceDataView (データをコピーせずにマッピングを参照する)
+	 */
+	tjs_error readToView(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name) {
+		DWORD size = 0;
+		const BYTE *ptr = loadResource_(type, name, &size);
+		if (!r) return TJS_S_OK;
+		r->Clear();
 		if (ptr) {
-			IStream *stream = TVPCreateIStream(*file, TJS_BS_WRITE);
-			if (stream) {
-				DWORD out = 0;
-				try {
-					if (stream->Write((BYTE*)ptr, size, &out) != S_OK) {
-						TVPThrowExceptionMessage(TJS_W("output error: %1"), *file);
-					}
-				} catch (...) {
-					stream->Release();
-					throw;
-				}
-				stream->Release();
-				if (size != out) {
-					TVPThrowExceptionMessage(TJS_W("write failed: %1"), *file);
-				}
-				if (r) *r = (tTVInteger)size;
+			DataView *view = 0;
+			tjs_error err = DataView::CreateObject(r, view);
+			if (TJS_FAILED(err)) return err;
+			view->assign(map_, ptr, size);
+		}
+		return TJS_S_OK;
+	}
+
+#ifndef RESOURCERW_NO_ICONRES
+	// RT_GROUP_ICON を読み込んでその言語を返す
+	WORD loadIconGroup_(tTJSVariant *name, IconResource::GroupContainer &grp) {
+		tTJSVariant type((tTVInteger)(tjs_intptr_t)RT_GROUP_ICON);
+		PEResource::ResData group;
+		findResource_(&type, name, group, true);
+		if (!grp.load(group.ptr, group.size)) {
+			tTJSVariant strname(*name);
+			strname.ToString();
+			TVPThrowExceptionMessage(TJS_W("invalid icon group: %1"), strname.GetString());
+		}
+		return group.lang;
+	}
+	// RT_ICON は同じ言語のものを優先する
+	const BYTE* findIconImage_(int id, WORD lang, DWORD &size) const {
+		const DWORD type = index_.key(PEResource::ResName((WORD)(tjs_intptr_t)RT_ICON));
+		const DWORD name = index_.key(PEResource::ResName((WORD)id));
+		const PEResource::Index::Record *rec = index_.find(type, name, lang);
+		if (!rec) rec = index_.find(type, name, 0);
+		if (!rec) return nullptr;
+		size = rec->size;
+		return rec->ptr;
+	}
+
+	/**
+	 * function readIconFrame(name, width, height, bpp=0);
+	 * @param name RT_GROUP_ICON のリソース名
+	 * @return 最も近い画像の RT_ICON の内容（octet）
+	 */
+	tjs_error readIconFrame(tTJSVariant *r, tTJSVariant *name, tTJSVariant *vw, tTJSVariant *vh, tjs_int optnum, tTJSVariant **optargs) {
+		IconResource::GroupContainer grp;
+		const WORD lang = loadIconGroup_(name, grp);
+		const int bpp = optnum > 0 ? (tjs_int)*optargs[0] : 0;
+		const int best = grp.findBest((tjs_int)*vw, (tjs_int)*vh, bpp);
+		int id = -1;
+		DWORD size = 0;
+		const BYTE *ptr = (best >= 0 && grp.getID(best, id)) ? findIconImage_(id, lang, size) : nullptr;
+		if (!ptr) {
+			tTJSVariant strname(*name);
+			strname.ToString();
+			TVPThrowExceptionMessage(TJS_W("icon image not found in group: %1"), strname.GetString());
+		}
+		if (r) {
+			tTJSVariantOctet *oct = TJSAllocVariantOctet((const tjs_uint8*)ptr, (tjs_uint)size);
+			*r = oct;
+			oct->Release();
+		}
+		return TJS_S_OK;
+	}
+
+	/**
+	 * function readIcon(name, file=void);
+	 * @param name RT_GROUP_ICON のリソース名
+	 * @param file 指定時は .ico ファイルとして書き出す
+	 * @return file 省略時は ResourceIconImage（画像はマッピングを直接参照する），指定時は書き出したバイト数
+	 */
+	tjs_error readIcon(tTJSVariant *r, tTJSVariant *name, tjs_int optnum, tTJSVariant **optargs) {
+		IconResource::GroupContainer grp;
+		const WORD lang = loadIconGroup_(name, grp);
+		struct ImageGet {
+			const ResourceReader &self;
+			WORD lang;
+			bool operator()(size_t, int id, const BYTE* &ptr, size_t &len) const {
+				DWORD size = 0;
+				ptr = self.findIconImage_(id, lang, size);
+				len = size;
+				return ptr != nullptr;
 			}
+		} iget = { *this, lang };
+
+		IconResource::ImageContainer tmp;
+		IconImage *icon = 0;
+		const bool tofile = optnum > 0 && optargs[0]->Type() != tvtVoid;
+		if (!tofile) {
+			if (!r) return TJS_S_OK;
+			tjs_error err = IconImage::CreateObject(r, icon);
+			if (TJS_FAILED(err)) return err;
+		}
+		IconResource::ImageContainer &image = icon ? icon->getImageContainer() : tmp;
+		if (!grp.extract(image, iget, map_)) {
+			if (r) r->Clear();
+			TVPThrowExceptionMessage(TJS_W("icon image not found in group: %1"), ttstr(*name));
+		}
+		if (tofile) {
+			// ヘッダと各画像をマッピングから直接書き出す
+			std::vector<BYTE> head(image.headerSize());
+			image.saveHeader(&head.front());
+			std::vector<WriteChunk> chunks;
+			chunks.reserve(image.getCount() + 1);
+			const WriteChunk hc = { &head.front(), (DWORD)head.size() };
+			chunks.push_back(hc);
+			tTVInteger total = head.size();
+			for (size_t n = 0; n < image.getCount(); ++n) {
+				WriteChunk c = { nullptr, 0 };
+				size_t len = 0;
+				image.getImage(n, c.ptr, len);
+				c.size = (DWORD)len;
+				chunks.push_back(c);
+				total += len;
+			}
+			const bool ok = WriteToFile(&chunks.front(), chunks.size(), *optargs[0]);
+			if (r) {
+				if (ok) *r = total;
+				else r->Clear();
+			}
+		}
+		return TJS_S_OK;
+	}
+#endif
+
+#ifndef RESOURCERW_NO_VERSIONRES
+	/**
+	 * function queryVersion(path, name=void);
+	 * @param path VerQueryValue と同じ形式のパス（"\\StringFileInfo\\041104b0\\ProductVersion" など）
+	 * @param name バージョンリソース名（省略時は最初のもの）
+	 * @return 値（見つからなければ void）
+	 */
+	tjs_error queryVersion(tTJSVariant *r, tTJSVariant *vpath, tjs_int optnum, tTJSVariant **optargs) {
+		if (r) r->Clear();
+		if (!map_) return TJS_S_OK;
+
+		PEResource::ResData data;
+		const PEResource::ResName type((WORD)(tjs_intptr_t)RT_VERSION);
+		if (optnum > 0 && optargs[0]->Type() != tvtVoid) {
+			PEResource::ResName name;
+			if (!getResName(optargs[0], name) || !index_.find(type, name, lang_, data)) return TJS_S_OK;
+		} else {
+			// 指定言語を優先し，無ければ最初に見つかったもの
+			PEResource::Index::iterator begin, end;
+			index_.range(index_.key(type), PEResource::Index::KEY_NONE, begin, end);
+			if (begin == end) return TJS_S_OK;
+			PEResource::Index::iterator it = begin;
+			while (it != end && it->lang != lang_) ++it;
+			if (it == end) it = begin;
+			data.ptr  = it->ptr;
+			data.size = it->size;
+		}
+
+		const ttstr path(*vpath);
+		VersionResource::QueryResult res;
+		if (VersionResource::VersionQuery::Find(data.ptr, data.size, (const char16_t*)path.c_str(), path.length(), res) && r) {
+			SetQueryResult(*r, res);
 		}
 		return TJS_S_OK;
 	}
+#endif
 
 	/**
 	 * function setLang(primlang, sublang);
@@ -884,13 +1675,12 @@ public:
 	 * function enumTypes()
 	 */
 	tjs_error enumTypes(tTJSVariant *r) {
-		if (r && handle_) {
+		if (r && map_) {
 			iTJSDispatch2 *arr = TJSCreateArrayObject();
 			*r = tTJSVariant(arr, arr);
 			arr->Release();
-			if (!::EnumResourceTypesW(handle_, EnumTypesProc, (LONG_PTR)arr)) {
-				ThrowLastError(TJS_W("EnumResourceTypes: %1"));
-			}
+			EnumResult result = { arr, 0 };
+			index_.enumTypes(result);
 		}
 		return TJS_S_OK;
 	}
@@ -898,16 +1688,15 @@ public:
 	 * function enumTypes(type)
 	 */
 	tjs_error enumNames(tTJSVariant *r, tTJSVariant *type) {
-		if (r && handle_) {
+		if (r && map_) {
 			iTJSDispatch2 *arr = TJSCreateArrayObject();
 			*r = tTJSVariant(arr, arr);
 			arr->Release();
 
-			LPCWSTR lpType, lpName;
-			if (getResTypeAndName(type, NULL, lpType, lpName)) {
-				if (!::EnumResourceNamesW(handle_, lpType, EnumNamesProc, (LONG_PTR)arr)) {
-					ThrowLastError(TJS_W("EnumResourceNames: %1"));
-				}
+			PEResource::ResName resType;
+			if (getResName(type, resType)) {
+				EnumResult result = { arr, 0 };
+				index_.enumNames(resType, result);
 			}
 		}
 		return TJS_S_OK;
@@ -916,17 +1705,74 @@ public:
 	 * function enumLangs(type, name)
 	 */
 	tjs_error enumLangs(tTJSVariant *r, tTJSVariant *type, tTJSVariant *name) {
-		if (r && handle_) {
+		if (r && map_) {
 			iTJSDispatch2 *arr = TJSCreateArrayObject();
 			*r = tTJSVariant(arr, arr);
 			arr->Release();
 
-			LPCWSTR lpType, lpName;
-			if (getResTypeAndName(type, name, lpType, lpName)) {
-				if (!::EnumResourceLanguagesW(handle_, lpType, lpName, EnumLangsProc, (LONG_PTR)arr)) {
-					ThrowLastError(TJS_W("EnumResourceLanguages: %1"));
+			PEResource::ResName resType, resName;
+			if (getResName(type, resType) && getResName(name, resName)) {
+				EnumResult result = { arr, 0 };
+				index_.enumLangs(resType, resName, result);
+			}
+		}
+		return TJS_S_OK;
+	}
+
+	/**
+	 * function enumAll()
+	 * @return [ [ type, [ [ name, [ [ lang, size ], ... ] ], ... ] ], ... ]
+	 */
+	tjs_error enumAll(tTJSVariant *r) {
+		if (!r || !map_) return TJS_S_OK;
+		typedef PEResource::Index::iterator iterator;
+		const std::vector<PEResource::Index::Record> &records = index_.records();
+		const iterator term = records.end();
+
+		// 同じキーが続く範囲の末尾
+		struct Span {
+			static iterator Type(iterator it, iterator end) { const DWORD t = it->type; while (it != end && it->type == t) ++it; return it; }
+			static iterator Name(iterator it, iterator end) { const DWORD n = it->name; while (it != end && it->name == n) ++it; return it; }
+		};
+		tjs_int ntypes = 0;
+		for (iterator it = records.begin(); it != term; it = Span::Type(it, term)) ++ntypes;
+
+		iTJSDispatch2 *types = CreateArray(ntypes);
+		*r = tTJSVariant(types, types);
+		types->Release();
+
+		tjs_int tn = 0;
+		for (iterator tb = records.begin(), te; tb != term; tb = te, ++tn) {
+			te = Span::Type(tb, term);
+			tjs_int nnames = 0;
+			for (iterator it = tb; it != te; it = Span::Name(it, te)) ++nnames;
+
+			iTJSDispatch2 *names = CreateArray(nnames);
+			tjs_int nn = 0;
+			for (iterator nb = tb, ne; nb != te; nb = ne, ++nn) {
+				ne = Span::Name(nb, te);
+				iTJSDispatch2 *langs = CreateArray((tjs_int)(ne - nb));
+				tjs_int ln = 0;
+				for (iterator it = nb; it != ne; ++it, ++ln) {
+					iTJSDispatch2 *item = CreateArray(2);
+					tTJSVariant vlang((tTVInteger)it->lang), vsize((tTVInteger)it->size);
+					item->PropSetByNum(TJS_MEMBERENSURE, 0, &vlang, item);
+					item->PropSetByNum(TJS_MEMBERENSURE, 1, &vsize, item);
+					SetArrayItem(langs, ln, item);
 				}
+				iTJSDispatch2 *pair = CreateArray(2);
+				tTJSVariant vname;
+				SetResName(vname, index_.name(nb->name));
+				pair->PropSetByNum(TJS_MEMBERENSURE, 0, &vname, pair);
+				SetArrayItem(pair, 1, langs);
+				SetArrayItem(names, nn, pair);
 			}
+			iTJSDispatch2 *pair = CreateArray(2);
+			tTJSVariant vtype;
+			SetResName(vtype, index_.name(tb->type));
+			pair->PropSetByNum(TJS_MEMBERENSURE, 0, &vtype, pair);
+			SetArrayItem(pair, 1, names);
+			SetArrayItem(types, tn, pair);
 		}
 		return TJS_S_OK;
 	}
@@ -943,10 +1789,20 @@ public:
 				.Function(TJS_W("readToText"), &ResourceReader::readToText)
 				.Function(TJS_W("readToFile"), &ResourceReader::readToFile)
 				.Function(TJS_W("readToOctet"), &ResourceReader::readToOctet)
+				.Function(TJS_W("readToView"), &ResourceReader::readToView)
 				.Function(TJS_W("enumTypes"), &ResourceReader::enumTypes)
 				.Function(TJS_W("enumNames"), &ResourceReader::enumNames)
 				.Function(TJS_W("enumLangs"), &ResourceReader::enumLangs)
-				.IsValid());
+				.Function(TJS_W("enumAll"), &ResourceReader::enumAll)
+#ifndef RESOURCERW_NO_ICONRES
+				.Function(TJS_W("readIcon"), &ResourceReader::readIcon)
+				.Function(TJS_W("readIconFrame"), &ResourceReader::readIconFrame)
+#endif
+#ifndef RESOURCERW_NO_VERSIONRES
+				.Function(TJS_W("queryVersion"), &ResourceReader::queryVersion)
+#endif
+				.IsValid() &&
+				DataView::Entry(link));
 	}
 };
 #endif
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTCODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace TextCodec {
+
+using std::size_t;
+typedef std::uint8_t  u8;
+typedef std::uint16_t u16;
+typedef std::uint32_t u32;
+
+//--------------------------------------------------------------
+// UTF-8 -> UTF-16（NUL または len で終了）
+//   dst には len 文字分の領域が必要（UTF-8 1バイトが UTF-16 2単位以上になることはない）
+//   不正なバイト列なら false
+template <typename CH>
+bool Utf8ToUtf16(const u8 *src, size_t len, CH *dst, size_t &outlen) {
+	const u8 *p = src, *end = src + len;
+	CH *out = dst;
+	while (p < end) {
+#ifdef TEXTCODEC_SSE2
+		// ASCII のみの16バイトはまとめて展開
+		if (sizeof(CH) == 2) {
+			const __m128i zero = _mm_setzero_si128();
+			while (end - p >= 16) {
+				const __m128i v = _mm_loadu_si128((const __m128i*)p);
+				if (_mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) break;
+				_mm_storeu_si128((__m128i*)out,       _mm_unpacklo_epi8(v, zero));
+				_mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(v, zero));
+				p += 16; out += 16;
+			}
+			if (p >= end) break;
+		}
+#endif
+		const u32 c = *p;
+		if (c < 0x80) {
+			if (!c) break; // 終端
+			*out++ = (CH)c;
+			++p;
+			continue;
+		}
+		u32 code, min;
+		size_t n;
+		if      ((c & 0xE0) == 0xC0) { code = c & 0x1F; n = 1; min = 0x80; }
+		else if ((c & 0xF0) == 0xE0) { code = c & 0x0F; n = 2; min = 0x800; }
+		else if ((c & 0xF8) == 0xF0) { code = c & 0x07; n = 3; min = 0x10000; }
+		else return false;
+		if ((size_t)(end - p) <= n) return false;
+		for (size_t i = 1; i <= n; ++i) {
+			const u32 t = p[i];
+			if ((t & 0xC0) != 0x80) return false;
+			code = (code << 6) | (t & 0x3F);
+		}
+		if (code < min || code > 0x10FFFF || (code >= 0xD800 && code < 0xE000)) return false;
+		if (code >= 0x10000 && sizeof(CH) == 2) {
+			code -= 0x10000;
+			*out++ = (CH)(0xD800 | (code >> 10));
+			*out++ = (CH)(0xDC00 | (code & 0x3FF));
+		} else {
+			*out++ = (CH)code;
+		}
+		p += n + 1;
+	}
+	outlen = out - dst;
+	return true;
+}
+
+//--------------------------------------------------------------
+// UTF-16 -> UTF-8（終端は書かない）
+//   dst には len * 3 バイトの領域が必要
+//   対になっていないサロゲートがあれば false
+template <typename CH>
+bool Utf16ToUtf8(const CH *src, size_t len, u8 *dst, size_t &outlen) {
+	const CH *p = src, *end = src + len;
+	u8 *out = dst;
+	while (p < end) {
+#ifdef TEXTCODEC_SSE2
+		// ASCII のみの8文字はまとめて詰める
+		if (sizeof(CH) == 2) {
+			const __m128i mask = _mm_set1_epi16((short)0xFF80);
+			const __m128i zero = _mm_setzero_si128();
+			while (end - p >= 8) {
+				const __m128i v = _mm_loadu_si128((const __m128i*)p);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask), zero)) != 0xFFFF) break;
+				_mm_storel_epi64((__m128i*)out, _mm_packus_epi16(v, v));
+				p += 8; out += 8;
+			}
+			if (p >= end) break;
+		}
+#endif
+		u32 c = (u32)*p++;
+		if (sizeof(CH) == 2) c &= 0xFFFF;
+		if (c < 0x80) {
+			*out++ = (u8)c;
+		} else if (c < 0x800) {
+			*out++ = (u8)(0xC0 | (c >> 6));
+			*out++ = (u8)(0x80 | (c & 0x3F));
+		} else {
+			if (c >= 0xD800 && c < 0xE000) {
+				if (c >= 0xDC00 || p >= end) return false;
+				u32 lo = (u32)*p;
+				if (sizeof(CH) == 2) lo &= 0xFFFF;
+				if (lo < 0xDC00 || lo >= 0xE000) return false;
+				++p;
+				c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+			}
+			if (c > 0x10FFFF) return false;
+			if (c < 0x10000) {
+				*out++ = (u8)(0xE0 | (c >> 12));
+			} else {
+				*out++ = (u8)(0xF0 | (c >> 18));
+				*out++ = (u8)(0x80 | ((c >> 12) & 0x3F));
+			}
+			*out++ = (u8)(0x80 | ((c >> 6) & 0x3F));
+			*out++ = (u8)(0x80 | (c & 0x3F));
+		}
+	}
+	outlen = out - dst;
+	return true;
+}
+
+} // namespace TextCodec
@@ -2,10 +2,10 @@
 
 #include <windows.h>
 #include <vector>
+#include <memory>
 #include <list>
 #include <string>
 #include <cstdint>
-#include <cctype>
 
 #if defined(__cplusplus) && (__cplusplus >= 201103L)
 #define METHOD_DELETE = delete
@@ -24,12 +24,90 @@ typedef std::u16string::value_type char16_t;
 
 #if defined(__cplusplus) && (__cplusplus >= 201103L)
 template<class T>
-using ChildList = std::list<T>;
+using ChildList = std::vector<T>;
 #else
 template<class T>
-struct ChildList : public std::list<T> {};
+struct ChildList : public std::vector<T> {};
 #endif
 
+//--------------------------------------------------------------
+// 文字列参照（実体は読み込み元バッファ・StringArena・静的文字列のいずれか，常に0終端）
+struct VsString {
+	const char16_t *ptr;
+	size_t len;
+
+	VsString() : ptr(Empty()), len(0) {}
+	VsString(const char16_t *str) : ptr(str), len(Length(str)) {}
+	VsString(const char16_t *str, size_t len) : ptr(str), len(len) {}
+	void clear() { ptr = Empty(); len = 0; }
+
+	size_t length() const { return len; }
+	bool empty() const { return len == 0; }
+	const char16_t* c_str() const { return ptr; }
+	bool operator==(const VsString &other) const { return len == other.len && std::equal(ptr, ptr + len, other.ptr); }
+	bool operator!=(const VsString &other) const { return !(*this == other); }
+
+	static size_t Length(const char16_t *str) {
+		size_t n = 0;
+		while (str[n]) ++n;
+		return n;
+	}
+	static const char16_t* Empty() {
+		static const char16_t zero = 0;
+		return &zero;
+	}
+};
+
+//--------------------------------------------------------------
+// 文字列領域（VersionContainer 単位でまとめて確保・解放）
+class StringArena {
+public:
+	enum { BLOCK = 4096 }; // 文字数
+
+	StringArena() : used_(BLOCK) {}
+	void clear() {
+		blocks_.clear();
+		used_ = BLOCK;
+	}
+	void swap(StringArena &other) {
+		blocks_.swap(other.blocks_);
+		std::swap(used_, other.used_);
+	}
+
+	template <typename CH>
+	VsString intern(const CH *str, size_t len) {
+		char16_t *dst = alloc(len + 1);
+		for (size_t n = 0; n < len; ++n) dst[n] = (char16_t)str[n];
+		dst[len] = 0;
+		return VsString(dst, len);
+	}
+	VsString intern(const u16string &str) { return intern(str.c_str(), str.length()); }
+
+private:
+	StringArena(const StringArena&) METHOD_DELETE ;
+	StringArena& operator=(const StringArena&) METHOD_DELETE ;
+
+	char16_t* alloc(size_t n) {
+		if (n > BLOCK / 4) {
+			// 大きな文字列は専用ブロック（現在のブロックはそのまま使い続ける）
+			std::unique_ptr<char16_t[]> block(new char16_t[n]);
+			char16_t *top = block.get();
+			blocks_.insert(blocks_.begin(), std::move(block));
+			return top;
+		}
+		if (used_ + n > BLOCK) {
+			blocks_.push_back(std::unique_ptr<char16_t[]>(new char16_t[BLOCK]));
+			used_ = 0;
+		}
+		char16_t *top = blocks_.back().get() + used_;
+		used_ += n;
+		return top;
+	}
+
+	std::vector<std::unique_ptr<char16_t[]> > blocks_;
+	size_t used_;
+};
+
 // 処理範囲
 struct VsRange {
 	size_t begin, end;
@@ -39,6 +117,7 @@ struct VsRange {
 // テーブル読み書き操作
 struct BlobReader {
 	BlobReader(const BYTE *src) : src(src) {}
+	const BYTE* pointer(size_t pos) const { return src + pos; }
 	bool alignment(VsRange &range) const {
 		const size_t fix = (range.begin & 3);
 		if (fix != 0) range.begin += (4-fix);
@@ -54,27 +133,19 @@ struct BlobReader {
 		}
 		return false;
 	}
-	int string(u16string &str, const VsRange &range) const {
+	int string(VsString &str, const VsRange &range) const {
 		if ((range.begin & 1) || (range.begin > range.end)) return -1;
 		const WCHAR *ptr = reinterpret_cast<const WCHAR*>(src + range.begin);
 		const WCHAR *end = reinterpret_cast<const WCHAR*>(src + range.end);
 		const WCHAR * const top = ptr;
-		for (str.clear(); ptr < end && *ptr; ++ptr) str.push_back((char16_t)*ptr);
-		return (ptr < end) ? ((int(ptr - top) + 1) * sizeof (WCHAR)) : -1;
+		while (ptr < end && *ptr) ++ptr;
+		if (ptr >= end) return -1;
+		str = VsString(reinterpret_cast<const char16_t*>(top), ptr - top); // 読み込み元を直接参照
+		return (int(ptr - top) + 1) * sizeof (WCHAR);
 	}
 private:
 	const BYTE *src;
 };
-struct BlobSizer {
-	BlobSizer() : total(0) {}
-	size_t position() const { return total; }
-	void padding() {
-		const size_t fix = (total & 3);
-		if (fix != 0) total += (4-fix);
-	}
-	void append(const void *ptr, size_t len) { total += len; }
-	size_t total;
-};
 template <typename T>
 struct BlobWriter {
 	BlobWriter(std::vector<T> &data) : data(data) {}
@@ -87,8 +158,14 @@ struct BlobWriter {
 		}
 	}
 	void append(const void *ptr, size_t len) {
-		auto src = reinterpret_cast<const T*>(ptr);
-		std::copy(src, src+len, std::back_inserter(data));
+		if (len == 0) return;
+		const size_t pos = data.size();
+		data.resize(pos + len);
+		memcpy(&data[pos], ptr, len);
+	}
+	// 書き出し済み位置の WORD を書き換える
+	void patch(size_t pos, WORD val) {
+		memcpy(&data[pos], &val, sizeof(val));
 	}
 	std::vector<T> &data;
 };
@@ -107,34 +184,56 @@ struct VsBase { //: protected NonCopyable {
 	WORD  wLength;      // The length, in bytes, of this self structure, including all structures indicated by the Children member if exists.
 	WORD  wValueLength; // The length, in bytes, of the Value member if Value member exists. otherwise equal to zero.
 	WORD  wType;        // The type of data in the version resource. This member is 1 if the version resource contains text data and 0 if the version resource contains binary data.
-	u16string szKey;
+	VsString szKey;
 //	WORD  Padding;      // As many zero words as necessary to align the next member on a 32-bit boundary.
+	DWORD keyHash;      // szKey の大文字小文字を無視したハッシュ
+	const BYTE *raw;    // 読み込み元の先頭（wLength バイト）
+	bool dirty;         // 読み込み後に変更されたか
 
-	VsBase() : wLength(0), wValueLength(0), wType(0) { szKey.clear(); }
+	VsBase() : wLength(0), wValueLength(0), wType(0), raw(nullptr), dirty(false) { setKey(VsString()); }
 	void clear(WORD type = 0) {
 		wLength = wValueLength = 0;
 		wType = type;
-		szKey.clear();
+		setKey(VsString());
+		raw = nullptr;
+		dirty = false;
 	}
+	void setKey(const VsString &key) {
+		szKey = key;
+		keyHash = HashKey(key);
+	}
+	// 変更したノードとその親は読み込み元をそのまま使わない
+	void touch() { dirty = true; }
 
 	template <class T>
 	int load(T &blob, const VsRange &range) {
 		VsRange valpos(range);
 		const VsRange head = { range.begin, range.begin + sizeof(WORD)*3 };
 		if (!blob.copy(this, head, range)) return -1;
+		raw = blob.pointer(range.begin);
+		dirty = false;
 		valpos.begin = head.end;
 		const int step = blob.string(szKey, valpos);
 		if (step < 0) return -1;
+		keyHash = HashKey(szKey);
 		valpos.begin += step;
 		return blob.alignment(valpos) ? (valpos.begin - range.begin) : -1;
 	}
 	template <class T>
 	void save(T &blob) {
-		blob.append(this, sizeof(WORD)*3);
+		blob.append(&wLength, sizeof(WORD)*3);
 		SaveString(szKey, blob);
 		blob.padding();
 	}
 
+	// 未変更なら読み込み元のバイト列をそのまま書き出す
+	template <class T>
+	bool saveRaw(T &blob) const {
+		if (!raw || dirty) return false;
+		blob.append(raw, wLength);
+		return true;
+	}
+
 	bool repos(VsRange &pos, const VsRange &range) const {
 		pos.end = range.begin + wLength;
 		return pos.end <= range.end;
@@ -144,25 +243,37 @@ struct VsBase { //: protected NonCopyable {
 		return (step == (int)wLength) ? step : -1;
 	}
 
+	// キーの比較はハッシュが一致したものだけ
+	static char16_t FoldCase(char16_t c) { return (c >= 'A' && c <= 'Z') ? (char16_t)(c + ('a' - 'A')) : c; }
+	static DWORD HashKey(const VsString &key) {
+		DWORD hash = 2166136261UL; // FNV-1a
+		for (size_t n = 0; n < key.length(); ++n) hash = (hash ^ FoldCase(key.c_str()[n])) * 16777619UL;
+		return hash;
+	}
+	static bool EqualIC(const VsString &a, const VsString &b) {
+		return a.length() == b.length() &&
+			std::equal(a.c_str(), a.c_str() + a.length(), b.c_str(),
+					   [](char16_t x, char16_t y) { return FoldCase(x) == FoldCase(y); });
+	}
+
 	template <typename V>
-	static V* FindChildren(ChildList<V> &Children, const u16string &key) {
-		for (auto it = Children.begin(); it != Children.end(); ++it) if (it->szKey == key) return &(*it);
+	static V* FindChildren(ChildList<V> &Children, const VsString &key) {
+		const DWORD hash = HashKey(key);
+		for (auto it = Children.begin(); it != Children.end(); ++it) if (it->keyHash == hash && it->szKey == key) return &(*it);
 		return nullptr;
 	}
 	template <typename V>
-	static const V* FindChildren(const ChildList<V> &Children, const u16string &key) {
-		for (auto it = Children.cbegin(); it != Children.cend(); ++it) if (it->szKey == key) return &(*it);
+	static const V* FindChildren(const ChildList<V> &Children, const VsString &key) {
+		const DWORD hash = HashKey(key);
+		for (auto it = Children.cbegin(); it != Children.cend(); ++it) if (it->keyHash == hash && it->szKey == key) return &(*it);
 		return nullptr;
 	}
 
 	template <typename V>
-	static typename ChildList<V>::iterator FindChildrenIC(ChildList<V> &Children, const u16string &key) {
+	static typename ChildList<V>::iterator FindChildrenIC(ChildList<V> &Children, const VsString &key) {
+		const DWORD hash = HashKey(key);
 		for (auto it = Children.begin(); it != Children.end(); ++it) {
-			if (key.size() == it->szKey.size()
-				&& std::equal(key.cbegin(), key.cend(), it->szKey.cbegin(),
-							  [](char16_t a, char16_t b) {
-								  return std::tolower(a) == std::tolower(b);
-							  })) return it;
+			if (it->keyHash == hash && EqualIC(key, it->szKey)) return it;
 		}
 		return Children.end();
 	}
@@ -192,7 +303,7 @@ struct VsBase { //: protected NonCopyable {
 	}
 
 	template <typename T>
-	static bool LoadString(u16string &str, T &blob, VsRange &valpos) {
+	static bool LoadString(VsString &str, T &blob, VsRange &valpos) {
 		const int step = blob.string(str, valpos);
 		if (step < 0) return false;
 		valpos.begin += step;
@@ -208,7 +319,7 @@ struct VsBase { //: protected NonCopyable {
 	}
 
 	template <typename T>
-	static void SaveString(const u16string &str, T &blob) {
+	static void SaveString(const VsString &str, T &blob) {
 		const WCHAR zero = 0;
 		blob.append(str.c_str(), str.length() * sizeof(char16_t));
 		blob.append(&zero, sizeof(zero)); // zero-terminator
@@ -222,13 +333,19 @@ struct VsBase { //: protected NonCopyable {
 		return str;
 	}
 
+	// update 時は子まで書き終わった時点で wLength を確定し，先頭に書き戻す
 	template <typename T>
 	struct LengthFiller {
-		LengthFiller(VsBase &target, const T &blob, bool update) : target(target), blob(blob), start(blob.position()), update(update) {}
-		~LengthFiller() { if (update) target.wLength = blob.position() - start; }
+		LengthFiller(VsBase &target, T &blob, bool update) : target(target), blob(blob), start(blob.position()), update(update) {}
+		~LengthFiller() {
+			if (update) {
+				target.wLength = (WORD)(blob.position() - start);
+				blob.patch(start, target.wLength);
+			}
+		}
 	private:
 		VsBase &target;
-		const T &blob;
+		T &blob;
 		const size_t start;
 		const bool update;
 	};
@@ -238,7 +355,7 @@ struct VsBase { //: protected NonCopyable {
 // \StringFileInfo\{LANGCODEPAGE}\Value値
 struct String : public VsBase {
 //	WORD  Value;
-	u16string Value;      // A zero-terminated string.
+	VsString Value;       // A zero-terminated string.
 
 	String() { clear(); }
 	void clear() {
@@ -261,6 +378,7 @@ struct String : public VsBase {
 	}
 	template <class T>
 	void save(T &blob, bool update) {
+		if (saveRaw(blob)) return;
 		LengthFiller<T> fill(*this, blob, update);
 		if (update) {
 			wValueLength = (Value.length() + 1); // [MEMO] byte数ではなく文字数(\0含める)
@@ -274,29 +392,67 @@ struct String : public VsBase {
 // \StringFileInfo\{LANGCODEPAGE} テーブル
 struct StringTable : public VsBase {
 	ChildList<String> Children; // An array of one or more String structures.
+	DWORD lang;                 // szKey の数値（hasLang の場合のみ）
+	bool hasLang;
 
 	StringTable() { clear(); }
 	void clear() {
 		VsBase::clear(1); // type:str
 		Children.clear();
+		index_.clear();
+		lang = 0;
+		hasLang = false;
 	}
-	void reset(DWORD lang) {
+	void reset(DWORD lang, StringArena &arena) {
 		clear();
-		changeLang(lang);
+		changeLang(lang, arena);
 	}
-	void changeLang(DWORD lang) {
+	void changeLang(DWORD lang, StringArena &arena) {
 		char16_t key[9];
-		szKey = ToHexString(lang, key);
+		setKey(arena.intern(ToHexString(lang, key), 8));
+		this->lang = lang;
+		hasLang = true;
+		touch();
 	}
 
-	bool change(const u16string &key, const u16string &val) {
-		String *str = FindChildren(Children, key);
-		if (str) str->Value = val;
-		else {
+	bool change(const VsString &key, const VsString &val) {
+		String *str = find(key);
+		if (str) {
+			str->Value = val;
+			str->touch();
+		} else {
 			Children.push_back(String());
-			Children.back().szKey = key;
+			Children.back().setKey(key);
 			Children.back().Value = val;
+			const IndexEntry ent = { Children.back().keyHash, (DWORD)(Children.size() - 1) };
+			index_.insert(std::upper_bound(index_.begin(), index_.end(), ent, IndexLess), ent);
 		}
+		touch();
+		return true;
+	}
+
+	// キーで検索（大文字小文字を区別）
+	String* find(const VsString &key) {
+		if (index_.size() != Children.size()) buildIndex();
+		const DWORD hash = HashKey(key);
+		const IndexEntry ent = { hash, 0 };
+		for (auto it = std::lower_bound(index_.begin(), index_.end(), ent, IndexLess); it != index_.end() && it->hash == hash; ++it) {
+			String &str = Children[it->pos];
+			if (str.szKey == key) return &str;
+		}
+		return nullptr;
+	}
+
+	static bool ParseLang(const VsString &key, DWORD &lang) {
+		if (key.length() != 8) return false;
+		DWORD val = 0;
+		for (size_t n = 0; n < 8; ++n) {
+			const char16_t c = FoldCase(key.c_str()[n]);
+			if      (c >= '0' && c <= '9') val = (val << 4) | (c - '0');
+			else if (c >= 'a' && c <= 'f') val = (val << 4) | (c - 'a' + 10);
+			else return false;
+		}
+		lang = val;
 		return true;
 	}
 	
@@ -309,10 +465,12 @@ struct StringTable : public VsBase {
 		if (!LoadHead(this, blob, valpos) ||
 			!repos(valpos, range) ||
 			(LoadChildren(Children, blob, valpos) < 0)) return -1;
+		hasLang = ParseLang(szKey, lang);
 		return next(valpos, range);
 	}
 	template <class T>
 	void save(T &blob, bool update) {
+		if (saveRaw(blob)) return;
 		LengthFiller<T> fill(*this, blob, update);
 		if (update) {
 			wValueLength = 0;
@@ -321,6 +479,20 @@ struct StringTable : public VsBase {
 		VsBase::save(blob);
 		SaveChildren(Children, blob, update);
 	}
+
+private:
+	// キーハッシュ順の索引（読み込み後は最初の検索時に作成）
+	struct IndexEntry { DWORD hash, pos; };
+	static bool IndexLess(const IndexEntry &a, const IndexEntry &b) { return a.hash < b.hash; }
+	void buildIndex() {
+		index_.resize(Children.size());
+		for (size_t n = 0; n < Children.size(); ++n) {
+			index_[n].hash = Children[n].keyHash;
+			index_[n].pos  = (DWORD)n;
+		}
+		std::stable_sort(index_.begin(), index_.end(), IndexLess);
+	}
+	std::vector<IndexEntry> index_;
 };
 //--------------------------------------------------------------
 // \VarFileInfo\Translation
@@ -335,7 +507,7 @@ struct Var : public VsBase {
 	}
 	void reset(DWORD lang) {
 		clear();
-		szKey = U16TEXT("Translation");
+		setKey(U16TEXT("Translation"));
 		Value.push_back(lang);
 	}
 
@@ -348,12 +520,14 @@ struct Var : public VsBase {
 		auto it = std::find(Value.cbegin(), Value.cend(), lang);
 		if (it != Value.cend()) return false; // 既に存在する
 		Value.push_back(lang);
+		touch();
 		return true;
 	}
 	bool remove(DWORD lang) {
 		auto it = std::find(Value.begin(), Value.end(), lang);
 		if (it == Value.end()) return false; // 削除対象が無い
 		Value.erase(it);
+		touch();
 		return true;
 	}
 
@@ -378,6 +552,7 @@ struct Var : public VsBase {
 	}
 	template <class T>
 	void save(T &blob, bool update) {
+		if (saveRaw(blob)) return;
 		LengthFiller<T> fill(*this, blob, update);
 		if (update) {
 			wValueLength = Value.size() * sizeof(DWORD);
@@ -394,6 +569,12 @@ struct Var : public VsBase {
 		}
 	}
 };
+//--------------------------------------------------------------
+// 一括変更用の文字列
+struct StringEdit {
+	VsString key, value;
+};
+
 //--------------------------------------------------------------
 // \StringFileInfo | \VarFileInfo テーブル
 struct FileInfo : public VsBase {
@@ -409,57 +590,80 @@ struct FileInfo : public VsBase {
 		VarChildren.clear();
 	}
 
-	void reset(int type, DWORD lang) {
+	void reset(int type, DWORD lang, StringArena &arena) {
 		clear();
 		childrenType = type;
 		if (type > 0) {
-			szKey = U16TEXT("StringFileInfo");
+			setKey(U16TEXT("StringFileInfo"));
 			StringChildren.push_back(StringTable());
-			StringChildren.back().reset(lang);
+			StringChildren.back().reset(lang, arena);
 		} else if (type < 0) {
-			szKey = U16TEXT("VarFileInfo");
+			setKey(U16TEXT("VarFileInfo"));
 			VarChildren.push_back(Var());
 			VarChildren.back().reset(lang);
 		}
 	}
 
-	bool changeString(const u16string &key, const u16string &val, DWORD lang) {
-		char16_t hex[9] = {0};
-		auto tbl = FindChildrenIC(StringChildren, ToHexString(lang, hex));
+	// 言語は数値で比較
+	ChildList<StringTable>::iterator findTable(DWORD lang) {
+		for (auto it = StringChildren.begin(); it != StringChildren.end(); ++it) {
+			if (it->hasLang && it->lang == lang) return it;
+		}
+		return StringChildren.end();
+	}
+
+	bool changeString(const VsString &key, const VsString &val, DWORD lang) {
+		auto tbl = findTable(lang);
 		if (tbl == StringChildren.end()) return false;
+		touch();
 		return tbl->change(key, val);
 	}
-	bool changeTranslation(const DWORD *srclang, const DWORD *dstlang) {
+	// langs が nullptr なら全テーブル，変更したテーブル数を返す
+	size_t changeStrings(const StringEdit *edits, size_t count, const std::vector<DWORD> *langs) {
+		size_t changed = 0;
+		for (auto tbl = StringChildren.begin(); tbl != StringChildren.end(); ++tbl) {
+			if (langs && (!tbl->hasLang || std::find(langs->cbegin(), langs->cend(), tbl->lang) == langs->cend())) continue;
+			for (size_t n = 0; n < count; ++n) tbl->change(edits[n].key, edits[n].value);
+			++changed;
+		}
+		if (changed > 0) touch();
+		return changed;
+	}
+	bool changeTranslation(const DWORD *srclang, const DWORD *dstlang, StringArena &arena) {
 		if (!srclang && !dstlang) return false;
 		const bool addnew = (srclang == nullptr && dstlang != nullptr);
 		const bool remove = (srclang != nullptr && dstlang == nullptr);
 //		const bool copy   = (srclang != nullptr && dstlang != nullptr);
 		if (childrenType > 0) {
-			char16_t srchex[9] = {0}, dsthex[9] = {0};
 			auto const term = StringChildren.end();
-			auto srctbl = srclang ? FindChildrenIC(StringChildren, ToHexString(*srclang, srchex)) : term;
-			auto dsttbl = dstlang ? FindChildrenIC(StringChildren, ToHexString(*dstlang, dsthex)) : term;
+			auto srctbl = srclang ? findTable(*srclang) : term;
+			auto dsttbl = dstlang ? findTable(*dstlang) : term;
 			if (addnew) {
 				if (dsttbl == term) return false; // 追加先が既に存在する
 				StringChildren.push_back(StringTable());
-				StringChildren.back().reset(*dstlang);
+				StringChildren.back().reset(*dstlang, arena);
+				touch();
 				return true;
 			} else if (remove) {
 				if (srctbl == term) return false; // 削除先が無い
 				StringChildren.erase(srctbl);
+				touch();
 				return true;
 			} else {
 				if (srctbl == term) return false; // コピー元が無い
 				if (dsttbl != term) return false; // コピー先が既に存在する
-				StringChildren.push_back(*srctbl);
-				StringChildren.back().changeLang(*dstlang);
+				const StringTable copy(*srctbl); // push_back で srctbl が無効になるため先に複製
+				StringChildren.push_back(copy);
+				StringChildren.back().changeLang(*dstlang, arena);
+				touch();
 				return true;
 			}
 		} else if (childrenType < 0) {
 			Var *var = FindChildren(VarChildren, U16TEXT("Translation"));
 			if (!var) return false;
-			if (remove) return var->remove(*srclang);
-			else        return var->addnew(*dstlang); // コピーはaddと同じ挙動
+			const bool result = remove ? var->remove(*srclang) : var->addnew(*dstlang); // コピーはaddと同じ挙動
+			if (result) touch();
+			return result;
 		}
 		return false;
 	}
@@ -474,14 +678,16 @@ struct FileInfo : public VsBase {
 
 		VsRange valpos(range);
 		if (!LoadHead(this, blob, valpos) || !repos(valpos, range)) return -1;
-		childrenType = (szKey == U16TEXT("StringFileInfo")) ? 1 : (szKey == U16TEXT("VarFileInfo")) ? -1 : 0;
+		childrenType = (szKey == VsString(U16TEXT("StringFileInfo"))) ? 1 : (szKey == VsString(U16TEXT("VarFileInfo"))) ? -1 : 0;
 		int step = 0;
 		if      (childrenType > 0) step = LoadChildren(StringChildren, blob, valpos);
 		else if (childrenType < 0) step = LoadChildren(   VarChildren, blob, valpos);
+		else valpos.begin = valpos.end; // 不明なテーブルは解釈せず読み込み元のまま書き出す
 		return step < 0 ? step : next(valpos, range);
 	}
 	template <class T>
 	void save(T &blob, bool update) {
+		if (saveRaw(blob)) return;
 		LengthFiller<T> fill(*this, blob, update);
 		if (update) {
 			wValueLength = 0;
@@ -519,34 +725,66 @@ struct VersionInfo : public VsBase {
 		::ZeroMemory(&Value, sizeof(Value));
 		Children.clear();
 	}
-	void reset(DWORD lang) {
+	void reset(DWORD lang, StringArena &arena) {
 		clear();
-		szKey = U16TEXT("VS_VERSION_INFO");
+		setKey(U16TEXT("VS_VERSION_INFO"));
 		Value.dwSignature = 0xFEEF04BD;
 		Value.dwFileFlagsMask = 0x3F;
 		Value.dwFileFlags     = 0x10; // VS_FF_INFOINFERRED [ファイルのバージョン構造は動的に作成されました。したがって、この構造体の一部のメンバーは空であるか、正しくない可能性があります。]
 		Value.dwFileOS        = 0x40004L; // VOS_NT | VOS_WINDOWS32
 		Children.push_back(FileInfo());
 		Children.push_back(FileInfo());
-		Children.front().reset( 1, lang);
-		Children.back() .reset(-1, lang);
+		Children.front().reset( 1, lang, arena);
+		Children.back() .reset(-1, lang, arena);
 	}
-	bool changeString(const u16string &key, const u16string &val, DWORD lang) {
+	bool changeString(const VsString &key, const VsString &val, DWORD lang) {
+		FileInfo *str = FindChildren(Children, U16TEXT("StringFileInfo"));
+		if (!str || !str->changeString(key, val, lang)) return false;
+		touch();
+		return true;
+	}
+	size_t changeStrings(const StringEdit *edits, size_t count, const std::vector<DWORD> *langs) {
 		FileInfo *str = FindChildren(Children, U16TEXT("StringFileInfo"));
-		return str && str->changeString(key, val, lang);
+		const size_t changed = (str && count > 0) ? str->changeStrings(edits, count, langs) : 0;
+		if (changed > 0) touch();
+		return changed;
 	}
-	bool changeTranslation(const DWORD *srclang, const DWORD *dstlang) {
+	// FileVersion / ProductVersion 文字列を VS_FIXEDFILEINFO の値にそろえる
+	size_t syncVersionStrings(StringArena &arena) {
+		const StringEdit edits[] = {
+			{ U16TEXT("FileVersion"),    FormatVersion(Value.dwFileVersionMS,    Value.dwFileVersionLS,    arena) },
+			{ U16TEXT("ProductVersion"), FormatVersion(Value.dwProductVersionMS, Value.dwProductVersionLS, arena) },
+		};
+		return changeStrings(edits, 2, nullptr);
+	}
+	static VsString FormatVersion(DWORD MS, DWORD LS, StringArena &arena) {
+		const WORD parts[] = { (WORD)(MS >> 16), (WORD)MS, (WORD)(LS >> 16), (WORD)LS };
+		char16_t str[4 * 6], *p = str;
+		for (int n = 0; n < 4; ++n) {
+			if (n > 0) *p++ = '.';
+			char16_t digits[5];
+			int len = 0;
+			WORD num = parts[n];
+			do { digits[len++] = (char16_t)('0' + num % 10); num /= 10; } while (num);
+			while (len > 0) *p++ = digits[--len];
+		}
+		return arena.intern(str, p - str);
+	}
+
+	bool changeTranslation(const DWORD *srclang, const DWORD *dstlang, StringArena &arena) {
 		if (!srclang && !dstlang) return false;
 		FileInfo *str = FindChildren(Children, U16TEXT("StringFileInfo"));
 		FileInfo *var = FindChildren(Children, U16TEXT("VarFileInfo"));
 		if (str && var) {
-			const bool rstr = str->changeTranslation(srclang, dstlang);
+			const bool rstr = str->changeTranslation(srclang, dstlang, arena);
 			if (!rstr) return false;
-			const bool rvar = var->changeTranslation(srclang, dstlang);
-			if (!rvar) {
-				if (dstlang) str->changeTranslation(dstlang, 0); // 追加済みの場合は削除
+			const bool rvar = var->changeTranslation(srclang, dstlang, arena);
+			if (!rvar && dstlang) {
+				str->changeTranslation(dstlang, 0, arena); // 追加済みの場合は削除（元の内容に戻る）
 				return false;
 			}
+			touch(); // StringFileInfo が変わった場合だけ（元のデータをそのまま使えなくなる）
+			if (!rvar) return false;
 			// 新規追加時に VS_FF_INFOINFERRED フラグを立てる
 			if (!srclang && dstlang) {
 				Value.dwFileFlagsMask |= 0x10;
@@ -562,7 +800,7 @@ struct VersionInfo : public VsBase {
 		return var ? var->getTranslations(langs) : 0;
 	}
 
-	bool changeFileInfo(const u16string &key, uint64_t val) {
+	bool changeFileInfo(const VsString &key, uint64_t val) {
 		/**/ if (key == U16TEXT("Signature"))      Value.dwSignature     = (DWORD)val;
 		else if (key == U16TEXT("StrucVersion"))   Value.dwStrucVersion  = (DWORD)val;
 		else if (key == U16TEXT("FileFlagsMask"))  Value.dwFileFlagsMask = (DWORD)val;
@@ -574,10 +812,93 @@ struct VersionInfo : public VsBase {
 		else if (key == U16TEXT("ProductVersion")) SetValueMSLS(val, Value.dwProductVersionMS, Value.dwProductVersionLS);
 		else if (key == U16TEXT("FileDate"))       SetValueMSLS(val, Value.dwFileDateMS,       Value.dwFileDateLS);
 		else return false;
+		touch();
 		return true;
 	}
 	static void SetValueMSLS(uint64_t val, DWORD &MS, DWORD &LS) { MS = (DWORD)(val>>32); LS = (DWORD)val; }
 
+	bool getFileInfo(const VsString &key, uint64_t &val) const {
+		/**/ if (key == U16TEXT("Signature"))      val = Value.dwSignature;
+		else if (key == U16TEXT("StrucVersion"))   val = Value.dwStrucVersion;
+		else if (key == U16TEXT("FileFlagsMask"))  val = Value.dwFileFlagsMask;
+		else if (key == U16TEXT("FileFlags"))      val = Value.dwFileFlags;
+		else if (key == U16TEXT("FileOS"))         val = Value.dwFileOS;
+		else if (key == U16TEXT("FileType"))       val = Value.dwFileType;
+		else if (key == U16TEXT("FileSubtype"))    val = Value.dwFileSubtype;
+		else if (key == U16TEXT("FileVersion"))    val = GetValueMSLS(Value.dwFileVersionMS,    Value.dwFileVersionLS);
+		else if (key == U16TEXT("ProductVersion")) val = GetValueMSLS(Value.dwProductVersionMS, Value.dwProductVersionLS);
+		else if (key == U16TEXT("FileDate"))       val = GetValueMSLS(Value.dwFileDateMS,       Value.dwFileDateLS);
+		else return false;
+		return true;
+	}
+	static uint64_t GetValueMSLS(DWORD MS, DWORD LS) { return ((uint64_t)MS << 32) | LS; }
+	// changeFileInfo / getFileInfo のキー一覧（nullptr 終端）
+	static const char16_t* const* FileInfoKeys() {
+		static const char16_t* const keys[] = {
+			U16TEXT("Signature"), U16TEXT("StrucVersion"),
+			U16TEXT("FileVersion"), U16TEXT("ProductVersion"),
+			U16TEXT("FileFlagsMask"), U16TEXT("FileFlags"),
+			U16TEXT("FileOS"), U16TEXT("FileType"), U16TEXT("FileSubtype"),
+			U16TEXT("FileDate"),
+			nullptr };
+		return keys;
+	}
+
+	const FileInfo* findFileInfo(const VsString &key) const { return FindChildren(Children, key); }
+
+	// 言語テーブルと Translation を空にする
+	void clearTranslations() {
+		FileInfo *str = FindChildren(Children, U16TEXT("StringFileInfo"));
+		FileInfo *var = FindChildren(Children, U16TEXT("VarFileInfo"));
+		if (!str || !var) return;
+		str->StringChildren.clear();
+		str->touch();
+		for (auto it = var->VarChildren.begin(); it != var->VarChildren.end(); ++it) {
+			if (it->szKey == U16TEXT("Translation")) { it->Value.clear(); it->touch(); }
+		}
+		var->touch();
+		touch();
+	}
+	// 言語テーブルを追加（既にあれば false）
+	bool addTable(DWORD lang, StringArena &arena) {
+		FileInfo *str = FindChildren(Children, U16TEXT("StringFileInfo"));
+		if (!str || str->findTable(lang) != str->StringChildren.end()) return false;
+		str->StringChildren.push_back(StringTable());
+		str->StringChildren.back().reset(lang, arena);
+		str->touch();
+		touch();
+		return true;
+	}
+	bool addTranslation(DWORD lang) {
+		FileInfo *var = FindChildren(Children, U16TEXT("VarFileInfo"));
+		Var *trans = var ? FindChildren(var->VarChildren, U16TEXT("Translation")) : nullptr;
+		if (!trans || !trans->addnew(lang)) return false;
+		var->touch();
+		touch();
+		return true;
+	}
+	// \VarFileInfo\{key} の値を置き換える（無ければ追加）
+	bool setVar(const VsString &key, const std::vector<DWORD> &values) {
+		FileInfo *var = FindChildren(Children, U16TEXT("VarFileInfo"));
+		if (!var) return false;
+		Var *ent = FindChildren(var->VarChildren, key);
+		if (!ent) {
+			var->VarChildren.push_back(Var());
+			ent = &var->VarChildren.back();
+			ent->setKey(key);
+		}
+		ent->Value = values;
+		ent->touch();
+		var->touch();
+		touch();
+		return true;
+	}
+	// StringFileInfo / VarFileInfo 以外のテーブルを追加
+	void addFileInfo(const FileInfo &info) {
+		Children.push_back(info);
+		touch();
+	}
+
 	template <class T>
 	int load(T &blob, const VsRange &range) {
 		clear();
@@ -595,6 +916,7 @@ struct VersionInfo : public VsBase {
 	}
 	template <class T>
 	void save(T &blob, bool update) {
+		if (saveRaw(blob)) return;
 		LengthFiller<T> fill(*this, blob, update);
 		if (update) {
 			wValueLength = sizeof(Value);
@@ -606,43 +928,257 @@ struct VersionInfo : public VsBase {
 	}
 };
 
+//--------------------------------------------------------------
+// VerQueryValue 相当のパス検索（ツリーを作らずにバイト列を直接たどる）
+struct QueryResult {
+	enum Kind {
+		NONE,
+		FIXED,        // "\" : VS_FIXEDFILEINFO
+		TEXT,         // 文字列値（size は終端を含まないバイト数）
+		BINARY,       // バイナリ値
+		TRANSLATION,  // \VarFileInfo\Translation : {WORD lang, WORD codepage} の配列
+	} kind;
+	const BYTE *ptr;
+	size_t size;
+};
+
+struct VersionQuery {
+	// path: "\" 区切り（大文字小文字は区別しない）
+	static bool Find(const BYTE *src, size_t len, const char16_t *path, size_t pathlen, QueryResult &result) {
+		result.kind = QueryResult::NONE;
+		result.ptr  = nullptr;
+		result.size = 0;
+
+		const BlobReader reader(src);
+		const VsRange all = { 0, len };
+		Node node;
+		if (!src || !Read(reader, all, node) || node.key != VsString(U16TEXT("VS_VERSION_INFO"))) return false;
+
+		bool root = true, var = false, parent = false; // var: VarFileInfo 直下か
+		const char16_t *p = path, *end = path + pathlen;
+		while (p < end) {
+			while (p < end && *p == '\\') ++p;
+			const char16_t *top = p;
+			while (p < end && *p != '\\') ++p;
+			if (p == top) break;
+			const VsString key(top, p - top);
+			if (!FindChild(reader, node, key, node)) return false;
+			parent = var;
+			var = root && node.key == VsString(U16TEXT("VarFileInfo"));
+			root = false;
+		}
+		if (root) {
+			result.kind = QueryResult::FIXED;
+		} else if (node.type == 1) {
+			// 文字列は wValueLength が文字数とは限らないので終端まで
+			if (node.valueLength == 0) return false; // 値の無いテーブル
+			result.kind = QueryResult::TEXT;
+			const BYTE *p16 = src + node.value, *e16 = src + node.end;
+			size_t n = 0;
+			while (p16 + n + 1 < e16 && (p16[n] | p16[n+1])) n += 2;
+			result.ptr  = p16;
+			result.size = n;
+			return true;
+		} else {
+			result.kind = (parent && IsTranslation(node.key)) ? QueryResult::TRANSLATION : QueryResult::BINARY;
+		}
+		if (node.valueSize == 0) {
+			result.kind = QueryResult::NONE;
+			return false;
+		}
+		result.ptr  = src + node.value;
+		result.size = node.valueSize;
+		return true;
+	}
+
+private:
+	struct Node {
+		size_t end;
+		WORD valueLength, type;
+		VsString key;
+		size_t value, valueSize, children;
+	};
+	static size_t Align(size_t pos) { return (pos + 3) & ~(size_t)3; }
+	static bool IsTranslation(const VsString &key) {
+		const VsString name(U16TEXT("Translation"));
+		return VsBase::EqualIC(key, name);
+	}
+
+	static bool Read(const BlobReader &reader, const VsRange &range, Node &node) {
+		WORD head[3];
+		const VsRange hpos = { range.begin, range.begin + sizeof(head) };
+		if (!reader.copy(head, hpos, range) || head[0] < sizeof(head)) return false;
+		node.end = range.begin + head[0];
+		if (node.end > range.end) return false;
+		node.valueLength = head[1];
+		node.type = head[2];
+		const VsRange kpos = { hpos.end, node.end };
+		const int step = reader.string(node.key, kpos);
+		if (step < 0) return false;
+		node.value = std::min(Align(kpos.begin + step), node.end);
+		const size_t bytes = (node.type == 1) ? head[1] * sizeof(WORD) : head[1];
+		node.valueSize = std::min(bytes, node.end - node.value);
+		node.children = std::min(Align(node.value + bytes), node.end);
+		return true;
+	}
+	static bool FindChild(const BlobReader &reader, const Node &parent, const VsString &key, Node &child) {
+		VsRange range = { parent.children, parent.end };
+		while (range.begin < range.end) {
+			Node node;
+			if (!Read(reader, range, node) || node.end <= range.begin) return false;
+			if (VsBase::EqualIC(key, node.key)) {
+				child = node;
+				return true;
+			}
+			range.begin = Align(node.end);
+		}
+		return false;
+	}
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // publicクラス
 
 class VersionContainer {
+	std::vector<BYTE> source_; // 読み込み元（未変更の文字列・ノードはここを参照する）
+	StringArena arena_;        // 変更した文字列の実体
+	std::list<std::vector<BYTE> > blobs_; // addRawFileInfo で追加したテーブルの実体
 	VersionInfo info_;
+
+	VersionContainer(const VersionContainer&) METHOD_DELETE ;
+	VersionContainer& operator=(const VersionContainer&) METHOD_DELETE ;
 public:
 	VersionContainer() {}
 	~VersionContainer() {}
 
 	void clear() {
 		info_.clear();
+		arena_.clear();
+		blobs_.clear();
+		source_.clear();
+	}
+	// 内容の入れ替え（文字列やノードの参照先ごと移る）
+	void swap(VersionContainer &other) {
+		source_.swap(other.source_);
+		arena_.swap(other.arena_);
+		blobs_.swap(other.blobs_);
+		std::swap(info_, other.info_);
 	}
 	void reset(DWORD lang = 0x041104b0L) { // Japanese - unicode
-		info_.reset(lang);
+		clear();
+		info_.reset(lang, arena_);
 	}
 
 	// \{VS_FIXEDFILEINFO:key} = val
-	bool changeFileInfo(const u16string &key, uint64_t val) {
+	bool changeFileInfo(const VsString &key, uint64_t val) {
 		return info_.changeFileInfo(key, val);
 	}
+	// FileVersion / ProductVersion 文字列を VS_FIXEDFILEINFO の値で全言語更新
+	size_t syncVersionStrings() {
+		return info_.syncVersionStrings(arena_);
+	}
 
 	// \StringFileInfo\{lang}\key = val
 	bool changeString(const u16string &key, const u16string &val, DWORD lang) {
-		return info_.changeString(key, val, lang);
+		return info_.changeString(arena_.intern(key), arena_.intern(val), lang);
+	}
+	bool getFileInfo(const VsString &key, uint64_t &val) const {
+		return info_.getFileInfo(key, val);
+	}
+	static const char16_t* const* FileInfoKeys() {
+		return VersionInfo::FileInfoKeys();
+	}
+	// 言語テーブル列挙: func(const StringTable &table)
+	template <class F>
+	void enumTables(F &func) const {
+		const FileInfo *str = info_.findFileInfo(U16TEXT("StringFileInfo"));
+		if (!str) return;
+		for (auto it = str->StringChildren.cbegin(); it != str->StringChildren.cend(); ++it) func(*it);
+	}
+
+	// 辞書からの再構築用: 固定情報は既定値で言語テーブルと Translation が空のツリーを作る
+	void create() {
+		reset();
+		info_.clearTranslations();
+	}
+	bool addTable(DWORD lang) {
+		return info_.addTable(lang, arena_);
+	}
+	bool addTranslation(DWORD lang) {
+		return info_.addTranslation(lang);
+	}
+	bool setVar(const VsString &key, const std::vector<DWORD> &values) {
+		return info_.setVar(arena_.intern(key.c_str(), key.length()), values);
+	}
+	// Var 列挙: func(const Var &var)
+	template <class F>
+	void enumVars(F &func) const {
+		const FileInfo *var = info_.findFileInfo(U16TEXT("VarFileInfo"));
+		if (!var) return;
+		for (auto it = var->VarChildren.cbegin(); it != var->VarChildren.cend(); ++it) func(*it);
+	}
+	// StringFileInfo / VarFileInfo 以外のテーブル列挙: func(const VsString &key, const BYTE *ptr, size_t len)
+	//   中身は解釈しないので読み込んだバイト列のまま渡す
+	template <class F>
+	void enumRawFileInfo(F &func) const {
+		for (auto it = info_.Children.cbegin(); it != info_.Children.cend(); ++it) {
+			if (it->childrenType == 0 && it->raw) func(it->szKey, it->raw, (size_t)it->wLength);
+		}
+	}
+	// enumRawFileInfo で得たバイト列からテーブルを追加
+	bool addRawFileInfo(const BYTE *ptr, size_t len) {
+		if (!ptr || len == 0) return false;
+		blobs_.push_back(std::vector<BYTE>(ptr, ptr + len));
+		const BlobReader reader(&blobs_.back().front());
+		const VsRange range = { 0, len };
+		FileInfo info;
+		const int result = info.load(reader, range);
+		if (result <= 0 || (size_t)result != len || info.childrenType != 0) {
+			blobs_.pop_back();
+			return false;
+		}
+		info_.addFileInfo(info);
+		return true;
+	}
+
+	// 一括変更用（文字列を内部に保持する）
+	VsString intern(const char16_t *str, size_t len) {
+		return arena_.intern(str, len);
+	}
+	// \StringFileInfo\{langs}\{key} = {value} を全て適用（langs==nullptr は全言語），変更したテーブル数を返す
+	size_t changeStrings(const std::vector<StringEdit> &edits, const std::vector<DWORD> *langs) {
+		return edits.empty() ? 0 : info_.changeStrings(&edits.front(), edits.size(), langs);
 	}
 	// copy srclang to dstlang / remove srclang (dstlang==nullptr) / create dstlang (srclang==nullptr)
 	bool changeTranslation(const DWORD *srclang, const DWORD *dstlang) {
-		return info_.changeTranslation(srclang, dstlang);
+		return info_.changeTranslation(srclang, dstlang, arena_);
 	}
 	// get Translation lang-codepage list
 	size_t getTranslations(std::vector<DWORD> &langs) const {
 		return info_.getTranslations(langs);
 	}
 
+	// 保存結果のバイト列: 変更が無ければ読み込み元を，あれば work に保存して返す
+	const BYTE* image(size_t &len, std::vector<BYTE> &work) {
+		if (info_.raw && !info_.dirty) {
+			len = source_.size();
+			return source_.empty() ? nullptr : &source_.front();
+		}
+		save(work);
+		len = work.size();
+		return work.empty() ? nullptr : &work.front();
+	}
+	bool query(const u16string &path, QueryResult &result, std::vector<BYTE> &work) {
+		size_t len = 0;
+		const BYTE *ptr = image(len, work);
+		return VersionQuery::Find(ptr, len, path.c_str(), path.length(), result);
+	}
+
 	bool load(const BYTE *ptr, size_t len) {
 		const VsRange range = { 0, len };
-		const BlobReader reader(ptr);
+		clear();
+		source_.assign(ptr, ptr + len);
+		const BlobReader reader(source_.empty() ? nullptr : &source_.front());
 		const int result = info_.load(reader, range);
 		return (result > 0) && (len == (size_t)result);
 	}
@@ -651,14 +1187,10 @@ public:
 	void save(std::vector<T> &vec) {
 		static_assert(sizeof (T) == 1, "sizeof(T) == 1");
 
-		BlobSizer sizer;
-		info_.save(sizer, true);
-
-		const size_t total = sizer.total;
 		vec.clear();
-		vec.reserve(total);
+		vec.reserve(info_.wLength); // 前回の長さを目安に確保
 		BlobWriter<T> writer(vec);
-		info_.save(writer, false);
+		info_.save(writer, true);
 	}
 };
 
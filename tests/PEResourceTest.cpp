@@ -0,0 +1,540 @@
+// PEResource.hpp の書き出しテスト（Linux 用）
+//   小さな PE32/PE32+ をその場で組み立てて Writer の各書き出し経路を確認する
+
+#include "PEResource.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+using namespace PEResource;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(expr) do { if (!(expr)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); ++failures; } } while (0)
+
+typedef std::vector<BYTE> Bytes;
+
+enum {
+	FILE_ALIGN = 0x200,
+	SECT_ALIGN = 0x1000,
+	RSRC_VA    = 0x2000,
+	RSRC_POS   = 0x400,
+	RT_RCDATA  = 10,
+};
+
+Bytes Pattern(size_t size, BYTE seed) {
+	Bytes data(size);
+	for (size_t n = 0; n < size; ++n) data[n] = (BYTE)(n * 7 + seed);
+	return data;
+}
+
+bool Save(const char *path, const Bytes &data) {
+	if (data.empty()) return false;
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return out.good();
+}
+Bytes Load(const char *path) {
+	std::ifstream in(path, std::ios::binary);
+	return Bytes(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// CheckSum の素直な実装（比較用）
+DWORD RefCheckSum(const Bytes &file, size_t sumpos) {
+	std::uint64_t sum = 0;
+	for (size_t n = 0; n < file.size(); n += 2) {
+		if (n >= sumpos && n < sumpos + 4) continue;
+		sum += file[n] | ((n + 1 < file.size()) ? file[n + 1] << 8 : 0);
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (DWORD)(sum + file.size());
+}
+
+//--------------------------------------------------------------
+// テスト用イメージ
+//   .text / .rsrc [/ .data] [+ 末尾データ] [+ 証明書テーブル]
+struct Sample {
+	bool is64;
+	bool rsrcLast;     // .rsrc を最後のセクションにする
+	size_t rsrcRaw;    // .rsrc の SizeOfRawData
+	bool checksum;     // CheckSum を設定する
+	bool cert;         // 証明書テーブルを付ける
+	size_t overlay;    // 末尾データのサイズ
+};
+
+struct Offsets { size_t opt, sec, secdir; };
+Offsets GetOffsets(const Bytes &file) {
+	Offsets o;
+	o.opt    = ReadU32(&file[0x3C]) + 24;
+	const bool is64 = ReadU16(&file[o.opt]) == 0x20B;
+	o.sec    = o.opt + (is64 ? 240 : 224);
+	o.secdir = o.opt + (is64 ? 112 : 96) + Image::DIR_SECURITY * 8;
+	return o;
+}
+
+Bytes MakeImage(const Sample &s, const Tree &resources) {
+	const size_t optlen = s.is64 ? 240 : 224;
+	const size_t nt = 0x40, opt = nt + 24, sec = opt + optlen;
+	Bytes rsrc;
+	{
+		struct Buffer {
+			Bytes &data;
+			bool write(const void *ptr, size_t len) {
+				const BYTE *p = static_cast<const BYTE*>(ptr);
+				data.insert(data.end(), p, p + len);
+				return true;
+			}
+		} buf = { rsrc };
+		const Builder builder(resources);
+		ChunkPump pump;
+		builder.emit(buf, RSRC_VA, pump);
+	}
+	const size_t rsrcSize = rsrc.size();
+	if (rsrcSize > s.rsrcRaw) return Bytes();
+	rsrc.resize(s.rsrcRaw, 0);
+
+	const WORD nsec = s.rsrcLast ? 2 : 3;
+	const size_t dataPos = RSRC_POS + s.rsrcRaw;
+	const DWORD  dataVa  = (DWORD)Builder::Align(RSRC_VA + s.rsrcRaw, SECT_ALIGN);
+	Bytes file(RSRC_POS, 0);
+	file[0] = 'M'; file[1] = 'Z';
+	Builder::PutU32(&file[0x3C], (DWORD)nt);
+	memcpy(&file[nt], "PE\0\0", 4);
+	Builder::PutU16(&file[nt + 4], s.is64 ? 0x8664 : 0x14C);
+	Builder::PutU16(&file[nt + 6], nsec);
+	Builder::PutU16(&file[nt + 20], (WORD)optlen);
+	Builder::PutU16(&file[nt + 22], 0x0102);
+	Builder::PutU16(&file[opt], s.is64 ? 0x20B : 0x10B);
+	Builder::PutU32(&file[opt + Image::OPT_SIZE_OF_INITDATA], (DWORD)(s.rsrcRaw + (s.rsrcLast ? 0 : FILE_ALIGN)));
+	Builder::PutU32(&file[opt + Image::OPT_SECTION_ALIGNMENT], SECT_ALIGN);
+	Builder::PutU32(&file[opt + Image::OPT_FILE_ALIGNMENT], FILE_ALIGN);
+	Builder::PutU32(&file[opt + Image::OPT_SIZE_OF_IMAGE], s.rsrcLast ? dataVa : dataVa + SECT_ALIGN);
+	Builder::PutU32(&file[opt + Image::OPT_SIZE_OF_HEADERS], FILE_ALIGN);
+	Builder::PutU32(&file[opt + (s.is64 ? 108 : 92)], 16);
+	const size_t dirs = opt + (s.is64 ? 112 : 96);
+	Builder::PutU32(&file[dirs + Image::DIR_RESOURCE * 8],     RSRC_VA);
+	Builder::PutU32(&file[dirs + Image::DIR_RESOURCE * 8 + 4], (DWORD)rsrcSize);
+
+	struct { const char *name; DWORD va, vsize, raw, pos, flags; } sections[3] = {
+		{ ".text", 0x1000,  FILE_ALIGN,        FILE_ALIGN,        FILE_ALIGN, 0x60000020UL },
+		{ ".rsrc", RSRC_VA, (DWORD)rsrcSize,   (DWORD)s.rsrcRaw,  RSRC_POS,   0x40000040UL },
+		{ ".data", dataVa,  FILE_ALIGN,        FILE_ALIGN,        (DWORD)dataPos, 0xC0000040UL },
+	};
+	for (WORD n = 0; n < nsec; ++n) {
+		BYTE *p = &file[sec + n * 40];
+		memcpy(p, sections[n].name, strlen(sections[n].name));
+		Builder::PutU32(p +  8, sections[n].vsize);
+		Builder::PutU32(p + 12, sections[n].va);
+		Builder::PutU32(p + 16, sections[n].raw);
+		Builder::PutU32(p + 20, sections[n].pos);
+		Builder::PutU32(p + 36, sections[n].flags);
+	}
+	const Bytes text = Pattern(FILE_ALIGN, 0x11);
+	memcpy(&file[FILE_ALIGN], text.data(), text.size());
+	file.insert(file.end(), rsrc.begin(), rsrc.end());
+	if (!s.rsrcLast) {
+		const Bytes data = Pattern(FILE_ALIGN, 0x22);
+		file.insert(file.end(), data.begin(), data.end());
+	}
+	if (s.overlay) {
+		const Bytes over = Pattern(s.overlay, 0x33);
+		file.insert(file.end(), over.begin(), over.end());
+	}
+	if (s.cert) {
+		file.resize(Builder::Align(file.size(), 8), 0);
+		Bytes cert = Pattern(64, 0x44);
+		Builder::PutU32(&cert[0], 64);
+		Builder::PutU32(&file[dirs + Image::DIR_SECURITY * 8],     (DWORD)file.size());
+		Builder::PutU32(&file[dirs + Image::DIR_SECURITY * 8 + 4], 64);
+		file.insert(file.end(), cert.begin(), cert.end());
+	}
+	if (s.checksum) Builder::PutU32(&file[opt + Image::OPT_CHECKSUM], RefCheckSum(file, opt + Image::OPT_CHECKSUM));
+	return file;
+}
+
+// 書き出し前の配置（Writer が選ぶ経路）
+Writer::Layout::Mode PlannedMode(const char *path, const Tree &tree) {
+	FileMapping map;
+	Image image;
+	Writer::Layout layout;
+	const Builder builder(tree);
+	if (!map.open(path) || !image.load(map.data(), map.size()) || !Writer::Plan(image, builder, tree.empty(), layout)) return (Writer::Layout::Mode)-1;
+	return layout.mode;
+}
+
+// 書き出し後のイメージの確認
+struct Result {
+	Bytes file;
+	Image image;
+	explicit Result(const char *path) : file(Load(path)) { image.load(file.data(), file.size()); }
+
+	bool has(WORD name, const Bytes &expect) const {
+		ResData data;
+		return (image.find(ResName(RT_RCDATA), ResName(name), 0, data) &&
+				data.size == expect.size() && memcmp(data.ptr, expect.data(), expect.size()) == 0);
+	}
+	// 指定言語のデータ（無ければ nullptr）
+	const BYTE* data(WORD name, WORD lang, const Bytes &expect) const {
+		ResData data;
+		if (!image.find(ResName(RT_RCDATA), ResName(name), lang, data) || data.lang != lang ||
+			data.size != expect.size() || memcmp(data.ptr, expect.data(), expect.size()) != 0) return nullptr;
+		return data.ptr;
+	}
+	bool missing(WORD name) const {
+		ResData data;
+		return !image.find(ResName(RT_RCDATA), ResName(name), 0, data);
+	}
+	bool endsWith(const Bytes &tail) const {
+		return file.size() >= tail.size() && memcmp(&file[file.size() - tail.size()], tail.data(), tail.size()) == 0;
+	}
+	bool checksumValid() const {
+		const size_t sumpos = GetOffsets(file).opt + Image::OPT_CHECKSUM;
+		return ReadU32(&file[sumpos]) == RefCheckSum(file, sumpos);
+	}
+	DWORD checksum() const { return ReadU32(&file[GetOffsets(file).opt + Image::OPT_CHECKSUM]); }
+	WORD sections() const { return ReadU16(&file[ReadU32(&file[0x3C]) + 6]); }
+	bool sectionIntact(WORD index, const Bytes &expect) const {
+		const BYTE *p = &file[GetOffsets(file).sec + index * 40];
+		const size_t pos = ReadU32(p + 20);
+		return pos + expect.size() <= file.size() && memcmp(&file[pos], expect.data(), expect.size()) == 0;
+	}
+};
+
+Tree Resources(const Bytes &first, const Bytes &second = Bytes()) {
+	Tree tree;
+	Bytes a(first), b(second);
+	tree.set(ResName(RT_RCDATA), ResName(1), 0, a);
+	if (!b.empty()) tree.set(ResName(RT_RCDATA), ResName(2), 0, b);
+	return tree;
+}
+
+//--------------------------------------------------------------
+void TestTail(bool is64) {
+	const char *path = "tail.exe";
+	const Sample s = { is64, true, FILE_ALIGN * 2, true, false, 300 };
+	const Bytes first = Pattern(100, 1), second = Pattern(700, 2);
+	CHECK(Save(path, MakeImage(s, Resources(first, second))));
+	const Bytes overlay = Pattern(300, 0x33);
+
+	// 伸ばす
+	const Bytes big = Pattern(5000, 3);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes data(big);
+		w.tree().set(ResName(RT_RCDATA), ResName(3), 0, data);
+		CHECK(PlannedMode(path, w.tree()) == Writer::Layout::TAIL);
+		CHECK(w.commit());
+	}
+	{
+		const Result r(path);
+		CHECK(r.image.isValid());
+		CHECK(r.has(1, first) && r.has(2, second) && r.has(3, big));
+		CHECK(r.endsWith(overlay));
+		CHECK(r.sectionIntact(0, Pattern(FILE_ALIGN, 0x11)));
+		CHECK(r.checksumValid());
+	}
+	// 縮める
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		CHECK(w.tree().remove(ResName(RT_RCDATA), ResName(3), 0));
+		CHECK(w.tree().remove(ResName(RT_RCDATA), ResName(2), 0));
+		CHECK(PlannedMode(path, w.tree()) == Writer::Layout::TAIL);
+		CHECK(w.commit());
+	}
+	{
+		const Result r(path);
+		CHECK(r.has(1, first) && r.missing(2) && r.missing(3));
+		CHECK(r.endsWith(overlay));
+		CHECK(r.file.size() == RSRC_POS + FILE_ALIGN + overlay.size());
+		CHECK(r.checksumValid());
+	}
+}
+
+void TestInplace(bool is64) {
+	const char *path = "inplace.exe";
+	const Sample s = { is64, false, FILE_ALIGN * 2, true, false, 100 };
+	const Bytes first = Pattern(100, 1);
+	const Bytes orig = MakeImage(s, Resources(first));
+	CHECK(Save(path, orig));
+
+	const Bytes added = Pattern(200, 4);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes data(added);
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, data);
+		CHECK(PlannedMode(path, w.tree()) == Writer::Layout::INPLACE);
+		CHECK(w.commit());
+	}
+	const Result r(path);
+	CHECK(r.has(1, first) && r.has(2, added));
+	CHECK(r.file.size() == orig.size());
+	CHECK(r.sections() == 3);
+	CHECK(r.sectionIntact(2, Pattern(FILE_ALIGN, 0x22)));
+	CHECK(r.endsWith(Pattern(100, 0x33)));
+	CHECK(r.checksumValid());
+}
+
+void TestAppend(bool is64) {
+	const char *path = "append.exe";
+	const Sample s = { is64, false, FILE_ALIGN, true, false, 100 };
+	const Bytes first = Pattern(100, 1);
+	CHECK(Save(path, MakeImage(s, Resources(first))));
+
+	const Bytes big = Pattern(3000, 5);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes data(big);
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, data);
+		CHECK(PlannedMode(path, w.tree()) == Writer::Layout::APPEND);
+		CHECK(w.commit());
+	}
+	const Result r(path);
+	CHECK(r.has(1, first) && r.has(2, big));
+	CHECK(r.sections() == 4);
+	CHECK(r.sectionIntact(2, Pattern(FILE_ALIGN, 0x22)));
+	CHECK(r.endsWith(Pattern(100, 0x33)));
+	CHECK(r.checksumValid());
+}
+
+void TestPatch(bool is64) {
+	const char *path = "patch.exe";
+	const Sample s = { is64, true, FILE_ALIGN * 2, true, false, 50 };
+	const Bytes orig = MakeImage(s, Resources(Pattern(400, 1), Pattern(64, 2)));
+	CHECK(Save(path, orig));
+
+	const Bytes smaller = Pattern(250, 6);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes data(smaller);
+		w.tree().set(ResName(RT_RCDATA), ResName(1), 0, data);
+		CHECK(w.commit());
+	}
+	const Result r(path);
+	CHECK(r.has(1, smaller) && r.has(2, Pattern(64, 2)));
+	CHECK(r.file.size() == orig.size());
+	CHECK(r.sections() == 2);
+	// ヘッダは CheckSum 以外そのまま
+	const size_t sumpos = GetOffsets(orig).opt + Image::OPT_CHECKSUM;
+	CHECK(memcmp(r.file.data(), orig.data(), sumpos) == 0 && memcmp(&r.file[sumpos + 4], &orig[sumpos + 4], RSRC_POS - sumpos - 4) == 0);
+	CHECK(r.checksum() != ReadU32(&orig[GetOffsets(orig).opt + Image::OPT_CHECKSUM]));
+	CHECK(r.checksumValid());
+}
+
+// 同じ内容のデータは1つにまとめて書き出す
+void TestDedup(bool is64) {
+	const char *path = "dedup.exe";
+	const Sample s = { is64, true, FILE_ALIGN * 2, true, false, 30 };
+	const Bytes same = Pattern(300, 1), other = Pattern(300, 2);
+	CHECK(Save(path, MakeImage(s, Resources(same))));
+
+	const size_t slot = Builder::Align(same.size(), 8);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes a(same), b(same), c(other);
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, a);
+		w.tree().set(ResName(RT_RCDATA), ResName(1), 0x411, b);
+		w.tree().set(ResName(RT_RCDATA), ResName(3), 0, c); // 同じサイズで内容が違う
+		// まとめなかった場合との差が減らしたバイト数
+		Tree distinct;
+		const Bytes unique[] = { same, Pattern(300, 3), Pattern(300, 4), other };
+		const WORD names[] = { 1, 1, 2, 3 }, langs[] = { 0, 0x411, 0, 0 };
+		for (int n = 0; n < 4; ++n) { Bytes data(unique[n]); distinct.set(ResName(RT_RCDATA), ResName(names[n]), langs[n], data); }
+		CHECK(Builder(distinct).size() - Builder(w.tree()).size() == slot * 2);
+		CHECK(w.commit());
+		CHECK(w.savedBytes() == slot * 2);
+	}
+	{
+		const Result r(path);
+		const BYTE *shared = r.data(1, 0, same);
+		CHECK(shared != nullptr);
+		CHECK(r.data(1, 0x411, same) == shared && r.data(2, 0, same) == shared);
+		const BYTE *diff = r.data(3, 0, other);
+		CHECK(diff != nullptr && diff != shared);
+		CHECK(r.checksumValid());
+	}
+	// 共有しているデータの1つを小さくしても他はそのまま（元の領域への直接書き込みはしない）
+	const Bytes smaller = Pattern(100, 5);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes data(smaller);
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, data);
+		CHECK(w.commit());
+		CHECK(w.savedBytes() == slot);
+	}
+	const Result r(path);
+	const BYTE *shared = r.data(1, 0, same);
+	CHECK(shared != nullptr && r.data(1, 0x411, same) == shared);
+	CHECK(r.data(2, 0, smaller) != nullptr && r.data(3, 0, other) != nullptr);
+	CHECK(r.endsWith(Pattern(30, 0x33)));
+	CHECK(r.checksumValid());
+}
+
+void TestSignature(bool is64, bool strip) {
+	const char *path = "signed.exe";
+	const Sample s = { is64, true, FILE_ALIGN, true, true, 40 };
+	const Bytes first = Pattern(100, 1);
+	const Bytes orig = MakeImage(s, Resources(first));
+	CHECK(Save(path, orig));
+	const Offsets o = GetOffsets(orig);
+	const Bytes cert(orig.end() - 64, orig.end());
+
+	const Bytes big = Pattern(2000, 7);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		w.setStripSignature(strip);
+		Bytes data(big);
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, data);
+		CHECK(w.commit());
+	}
+	const Result r(path);
+	CHECK(r.has(1, first) && r.has(2, big));
+	const DWORD certpos = ReadU32(&r.file[o.secdir]), certsize = ReadU32(&r.file[o.secdir + 4]);
+	if (strip) {
+		CHECK(certpos == 0 && certsize == 0);
+		CHECK(r.endsWith(Pattern(40, 0x33)));
+	} else {
+		CHECK(certsize == 64 && certpos + 64 == r.file.size());
+		CHECK(r.endsWith(cert));
+	}
+	CHECK(r.checksumValid());
+}
+
+void TestNoCheckSum(bool is64) {
+	const char *path = "nosum.exe";
+	const Sample s = { is64, true, FILE_ALIGN, false, false, 0 };
+	CHECK(Save(path, MakeImage(s, Resources(Pattern(100, 1)))));
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		Bytes data(Pattern(1500, 8));
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, data);
+		CHECK(w.commit());
+	}
+	const Result r(path);
+	CHECK(r.has(2, Pattern(1500, 8)));
+	CHECK(r.checksum() == 0);
+}
+
+// 書き出し時に読み込むデータ（writeFromFile 相当）
+class MemorySource : public Source {
+public:
+	// limit バイトまでしか読めない（読み込み失敗の再現）
+	explicit MemorySource(const Bytes &data, size_t limit = (size_t)-1) : data_(data), limit_(std::min(limit, data.size())), pos_(0), opened_(0) {}
+	bool open() { pos_ = 0; ++opened_; return true; }
+	size_t read(BYTE *buf, size_t len) {
+		// 一度に少しずつ返す
+		len = std::min(std::min(len, limit_ - pos_), (size_t)100000);
+		memcpy(buf, &data_[pos_], len);
+		pos_ += len;
+		return len;
+	}
+	void close() {}
+	int opened() const { return opened_; }
+private:
+	Bytes data_;
+	size_t limit_;
+	size_t pos_;
+	int opened_;
+};
+
+void TestSource(bool is64, bool rsrcLast) {
+	const char *path = "source.exe";
+	const Sample s = { is64, rsrcLast, FILE_ALIGN * 2, true, false, 100 };
+	const Bytes first = Pattern(100, 1);
+	CHECK(Save(path, MakeImage(s, Resources(first))));
+
+	// CHUNK をまたぐサイズ
+	const Bytes big = Pattern(ChunkPump::CHUNK * 2 + 12345, 9);
+	std::shared_ptr<MemorySource> src = std::make_shared<MemorySource>(big);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, src, (DWORD)big.size());
+		CHECK(w.commit());
+	}
+	CHECK(src->opened() == 1);
+	const Result r(path);
+	CHECK(r.has(1, first) && r.has(2, big));
+	CHECK(r.endsWith(Pattern(100, 0x33)));
+	CHECK(r.checksumValid());
+}
+
+// 読み込みに失敗しても元ファイルはそのまま（.rsrc が最後でも一時ファイルを経由する）
+void TestSourceFailure(bool is64) {
+	const char *path = "source_fail.exe";
+	const Sample s = { is64, true, FILE_ALIGN * 2, true, false, 100 };
+	const Bytes orig = MakeImage(s, Resources(Pattern(100, 1)));
+	CHECK(Save(path, orig));
+
+	const Bytes big = Pattern(ChunkPump::CHUNK + 500, 9);
+	std::shared_ptr<MemorySource> src = std::make_shared<MemorySource>(big, ChunkPump::CHUNK / 2);
+	{
+		Writer w;
+		CHECK(w.open(path, false));
+		w.tree().set(ResName(RT_RCDATA), ResName(2), 0, src, (DWORD)big.size());
+		CHECK(PlannedMode(path, w.tree()) == Writer::Layout::TAIL);
+		CHECK(!w.commit());
+	}
+	CHECK(Load(path) == orig);
+}
+
+void TestRollback(bool is64, bool clean) {
+	const char *path = "rollback.exe";
+	const Sample s = { is64, true, FILE_ALIGN * 2, true, false, 0 };
+	const Bytes first = Pattern(100, 1), second = Pattern(200, 2);
+	CHECK(Save(path, MakeImage(s, Resources(first, second))));
+	{
+		Writer w;
+		CHECK(w.open(path, clean));
+		const size_t opened = w.tree().pendingCount();
+		CHECK(opened == (clean ? 2u : 0u));
+		Bytes data(Pattern(300, 3));
+		w.tree().set(ResName(RT_RCDATA), ResName(3), 0, data);
+		w.tree().remove(ResName(RT_RCDATA), ResName(1), 0);
+		w.rollback();
+		// open 直後と同じ状態
+		CHECK(w.tree().pendingCount() == opened);
+		CHECK(w.tree().empty() == clean);
+		if (clean) CHECK(w.commit());
+	}
+	const Result r(path);
+	CHECK(r.missing(3));
+	if (clean) CHECK(r.missing(1) && r.missing(2));
+	else       CHECK(r.has(1, first) && r.has(2, second));
+}
+
+} // namespace
+
+int main() {
+	for (int n = 0; n < 2; ++n) {
+		const bool is64 = (n == 1);
+		TestTail(is64);
+		TestInplace(is64);
+		TestAppend(is64);
+		TestPatch(is64);
+		TestDedup(is64);
+		TestSignature(is64, false);
+		TestSignature(is64, true);
+		TestNoCheckSum(is64);
+		TestSource(is64, true);
+		TestSource(is64, false);
+		TestSourceFailure(is64);
+		TestRollback(is64, false);
+		TestRollback(is64, true);
+	}
+	if (failures) std::printf("%d check(s) failed\n", failures);
+	else          std::printf("all checks passed\n");
+	return failures ? 1 : 0;
+}